@@ -13,12 +13,19 @@ class CommonConceptGraphItem : public HyperedgeItem
             INSTANCE
         } CommonConceptGraphItemType;
 
+        enum { Type = COMMONCONCEPTGRAPH_ITEM };
+
         CommonConceptGraphItem(const UniqueId& uid,
                                CommonConceptGraphItemType type,
                                std::string superClassLabel
                               );
         virtual ~CommonConceptGraphItem();
 
+        int type() const
+        {
+            return Type;
+        }
+
         QRectF boundingRect() const;
 
         void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
@@ -48,6 +55,11 @@ class CommonConceptGraphEdgeItem : public EdgeItem
         CommonConceptGraphEdgeItem(HyperedgeItem *from, HyperedgeItem *to, const Type type=TO, const Style style=SOLID_CURVED);
         virtual ~CommonConceptGraphEdgeItem();
 
+        int type() const
+        {
+            return COMMONCONCEPTGRAPH_EDGE_ITEM;
+        }
+
         void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
                    QWidget *widget);
 
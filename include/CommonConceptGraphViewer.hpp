@@ -3,6 +3,8 @@
 
 #include "CommonConceptGraph.hpp"
 #include "ConceptgraphViewer.hpp"
+#include <deque>
+#include <set>
 
 // Generated by MOC
 namespace Ui
@@ -11,6 +13,7 @@ namespace Ui
 }
 
 class CommonConceptGraphItem;
+class UidListModel;
 
 class CommonConceptGraphScene : public ConceptgraphScene
 {
@@ -24,7 +27,7 @@ class CommonConceptGraphScene : public ConceptgraphScene
         void removeItem(QGraphicsItem *item);
         CommonConceptGraph& graph()
         {
-            return currentCommonConceptGraph;
+            return *mpCommonConceptGraph;
         }
         QList<CommonConceptGraphItem*> selectedCommonConceptGraphItems();
         bool classesShown() { return mShowClasses; }
@@ -32,6 +35,37 @@ class CommonConceptGraphScene : public ConceptgraphScene
         QStringList getAllClassUIDs();
         QStringList getAllRelationUIDs();
 
+        // Kinds of relations a fact can be classified as (combined into a bit mask)
+        enum RelationKind {
+            NO_RELATION = 0,
+            HAS_A = 1,
+            PART_OF = 2,
+            IS_A = 4,
+            INSTANCE_OF = 8,
+            CONNECTS = 16
+        };
+
+        // Partition of all concepts and relations of the graph (kept up to date by the scene)
+        enum Category {
+            NO_CATEGORY = 0,
+            CLASS_CATEGORY,
+            INSTANCE_CATEGORY,
+            RELATION_CLASS_CATEGORY,
+            FACT_CATEGORY,
+            NUM_CATEGORIES
+        };
+        // Returns all members of a category (in the order they became known to the scene)
+        Hyperedges categoryMembers(const Category category) const;
+        int categorySize(const Category category) const
+        {
+            return mCategoryMembers[category].size();
+        }
+        // Returns the current category of an edge (NO_CATEGORY if unknown)
+        Category categoryOf(const UniqueId& id) const
+        {
+            return mCategoryOf.value(mUids.find(id), NO_CATEGORY);
+        }
+
     signals:
         void classAdded(const UniqueId id);
         void classRemoved(const UniqueId id);
@@ -39,10 +73,16 @@ class CommonConceptGraphScene : public ConceptgraphScene
         void instanceRemoved(const UniqueId id);
         void relationAdded(const UniqueId id);
         void relationRemoved(const UniqueId id);
+        // The category of the edge changed (or many categories, if id is empty)
+        void categoryChanged(const UniqueId id);
 
     public slots:
+        // Resumes the sync job (called by mpUpdateTimer)
         void updateVisualization();
-        void visualize(const UniqueId& updatedId="");
+        // Syncs the items with the graph in time slices of a few ms. Resumes on every call (and by itself) until done.
+        void visualize();
+        // Schedules the concept (e.g. an edited one) to be synced before all others
+        void visualize(const UniqueId& updatedId);
         void visualize(const CommonConceptGraph& graph);
         void addInstance(const UniqueId superId, const QString& label);
         void addClass(const UniqueId id, const QString& label);
@@ -52,12 +92,62 @@ class CommonConceptGraphScene : public ConceptgraphScene
         void updateEdge(const UniqueId id, const QString& label);
         void showClasses(const bool value);
         void showInstances(const bool value);
+        // Syncs a fixed number of concepts per slice instead of using a time budget
+        void setDeterministic(bool enable);
 
     protected:
+        // Queues all concepts (and all items of vanished concepts); visible ones are queued first
+        void startSweep();
+        // Appends a concept to the sync queue (unless it is queued already)
+        void queueConcept(const UniqueId& conceptId);
+        // Queues the concepts whose items depend on the given one: its instances & subclasses (superclass label)
+        // and the concepts related to it (visibility of their lines)
+        void queueDependents(const UniqueId& conceptId);
+        // Creates, updates or deletes the item of a single concept
+        void visualizeConcept(const UniqueId& conceptId);
+        // Sets the label and the superclass label of the item (and the superclass labels of its instances & subclasses)
+        void refreshLabel(HyperedgeItem *item);
+        void refreshConceptLabel(CommonConceptGraphItem *item);
+        // Rewires the items of the given concepts (and their relations) after undo/redo
+        void refreshEdges(const Hyperedges& ids);
+        // Drops the cached classifications and updates the category index of the changed edges
+        void edgesChanged(const Hyperedges& ids);
+        // Concatenates the labels of the given superclasses
+        QString superclassLabel(const Hyperedges& superclassIds);
+        // Returns the kinds of relations (see RelationKind) the fact is a fact of (including all superrelations)
+        // NOTE: Results are cached until the graph gets changed through this scene
+        int classifyFact(const UniqueId& factId);
+        int classifyRelation(const UniqueId& relId);
+        void invalidateClassification();
+        // Shows or hides the items and all lines attached to them (or their children) at once
+        void applyVisibility(const QSet<CommonConceptGraphItem*>& items, const bool visible);
+        // Updates the category of a single edge
+        // NOTE: Only needs the edge itself and its direct neighbours, not the whole graph
+        void categorize(const UniqueId& id);
+        void setCategory(const UidIndex::Index index, const Category category);
+        // Rebuilds the whole category index (e.g. after an import)
+        void rebuildCategories();
+
         QTimer* mpUpdateTimer;
+        // The sync job: concepts to be synced first and the remaining concepts of a full sweep
+        std::deque<UidIndex::Index> mSyncQueue;
+        std::set<UidIndex::Index> mSyncQueued;
+        Hyperedges mSweep;
+        std::size_t mSweepIndex;
+        bool mDeterministic;
+        // Cached classification of facts and relations (by interned id)
+        QHash<UidIndex::Index, int> mFactKinds;
+        QHash<UidIndex::Index, int> mRelationKinds;
+        // All class & instance items by their current classification (to show or hide them at once)
+        QSet<CommonConceptGraphItem*> mClassItems;
+        QSet<CommonConceptGraphItem*> mInstanceItems;
+        // Category index (by interned id)
+        QHash<UidIndex::Index, Category> mCategoryOf;
+        std::set<UidIndex::Index> mCategoryMembers[NUM_CATEGORIES];
         bool mShowClasses;
         bool mShowInstances;
-        CommonConceptGraph currentCommonConceptGraph;
+        // Typed view of mpGraph (owned by this scene)
+        CommonConceptGraph* mpCommonConceptGraph;
 };
 
 class CommonConceptGraphEditor : public ConceptgraphEditor
@@ -70,13 +160,23 @@ class CommonConceptGraphEditor : public ConceptgraphEditor
 
         CommonConceptGraphScene* scene()
         {
-            return dynamic_cast<CommonConceptGraphScene*>(QGraphicsView::scene());
+            // NOTE: See HypergraphView::scene()
+            if (QGraphicsView::scene() != mpCachedScene)
+            {
+                mpCachedScene = QGraphicsView::scene();
+                mpCommonConceptGraphScene = dynamic_cast<CommonConceptGraphScene*>(mpCachedScene);
+            }
+            return mpCommonConceptGraphScene;
         }
 
     protected:
         void keyPressEvent(QKeyEvent * event);
         void mousePressEvent(QMouseEvent* event);
         void mouseReleaseEvent(QMouseEvent* event);
+
+    private:
+        QGraphicsScene *mpCachedScene;
+        CommonConceptGraphScene *mpCommonConceptGraphScene;
 };
 
 class CommonConceptGraphWidget : public ConceptgraphWidget
@@ -93,10 +193,25 @@ class CommonConceptGraphWidget : public ConceptgraphWidget
         void loadFromGraph(const CommonConceptGraph& graph);
         void onGraphChanged(const UniqueId id);
         void onGraphChanged(QGraphicsItem* item);
+        // Moves the edge to the list of its new category (or rebuilds all lists if id is empty)
+        void onCategoryChanged(const UniqueId id);
+        // Updates the stats (and rebuilds all lists if requested); coalesced by onGraphChanged
+        void updateLists();
 
     protected:
         // Triggered when widget is about to get visible
         void showEvent(QShowEvent *event);
+        // The stats label is part of the extended ui
+        QLabel* statsLabel();
+
+        // Models of the list panes
+        // NOTE: All of them follow the category index of the scene (by its per-edge changes)
+        UidListModel*                  mpClassModel;
+        UidListModel*                  mpInstanceModel;
+        UidListModel*                  mpRelationModel;
+        UidListModel*                  mpFactModel;
+        bool                           mListUpdatePending;
+        bool                           mListRebuildPending;
 
         CommonConceptGraphScene*       mpCommonConceptScene;
         CommonConceptGraphEditor*      mpCommonConceptEditor;
@@ -13,9 +13,16 @@ class ConceptgraphItem : public HyperedgeItem
             RELATION
         } ConceptgraphItemType;
 
+        enum { Type = CONCEPTGRAPH_ITEM };
+
         ConceptgraphItem(const UniqueId& uid, ConceptgraphItemType type);
         virtual ~ConceptgraphItem();
 
+        int type() const
+        {
+            return Type;
+        }
+
         void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
                    QWidget *widget);
 
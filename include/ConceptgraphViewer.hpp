@@ -18,7 +18,7 @@ class ConceptgraphScene : public ForceBasedScene
         void removeItem(QGraphicsItem *item);
         Conceptgraph& graph()
         {
-            return currentConceptGraph;
+            return *mpConceptGraph;
         }
         QList<ConceptgraphItem*> selectedConceptgraphItems();
 
@@ -36,7 +36,16 @@ class ConceptgraphScene : public ForceBasedScene
         void removeEdge(const UniqueId id);
         void updateEdge(const UniqueId id, const QString& label);
     protected:
-        Conceptgraph currentConceptGraph;
+        // See HypergraphScene
+        ConceptgraphScene(Conceptgraph* graph, QObject * parent);
+        // Updates the items of the given edges only (after undo/redo)
+        void refreshEdges(const Hyperedges& ids);
+        // Creates or removes the item of a single edge (returns the item or NULL)
+        ConceptgraphItem* syncItem(const UniqueId& id);
+
+        // Typed view of mpGraph (owned by this scene if mOwnsConceptGraph is set)
+        Conceptgraph* mpConceptGraph;
+        bool mOwnsConceptGraph;
 };
 
 class ConceptgraphEditor : public HypergraphEdit
@@ -49,13 +58,23 @@ class ConceptgraphEditor : public HypergraphEdit
 
         ConceptgraphScene* scene()
         {
-            return dynamic_cast<ConceptgraphScene*>(QGraphicsView::scene());
+            // NOTE: See HypergraphView::scene()
+            if (QGraphicsView::scene() != mpCachedScene)
+            {
+                mpCachedScene = QGraphicsView::scene();
+                mpConceptgraphScene = dynamic_cast<ConceptgraphScene*>(mpCachedScene);
+            }
+            return mpConceptgraphScene;
         }
 
     protected:
         void keyPressEvent(QKeyEvent * event);
         void mousePressEvent(QMouseEvent* event);
         void mouseReleaseEvent(QMouseEvent* event);
+
+    private:
+        QGraphicsScene *mpCachedScene;
+        ConceptgraphScene *mpConceptgraphScene;
 };
 
 class ConceptgraphWidget : public HypergraphViewer
@@ -0,0 +1,137 @@
+#ifndef _FORCE_LAYOUT_HPP
+#define _FORCE_LAYOUT_HPP
+
+#include <QVector>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QWaitCondition>
+#include "HypergraphTypes.hpp"
+#include "QuadTree.hpp"
+#include "MultilevelLayout.hpp"
+
+/*
+    A plain snapshot of the layout problem.
+    It does not reference any QGraphicsItem, so it can safely be processed outside of the GUI thread.
+    All data is kept in contiguous arrays (structure of arrays).
+*/
+struct LayoutSnapshot
+{
+    // Positions of all bodies
+    QVector<qreal> x;
+    QVector<qreal> y;
+    // Pinned bodies (e.g. selected items) neither move nor repel others
+    QVector<bool> pinned;
+    // Frozen bodies repel others but do not move (e.g. the border of a local layout)
+    QVector<bool> frozen;
+    // Springs between bodies (indices into x/y)
+    QVector<int> edgeSources;
+    QVector<int> edgeTargets;
+    // Masses of the bodies (e.g. the number of bodies collapsed into one by a multilevel layout), unit masses if empty
+    // NOTE: Only the Barnes-Hut repulsion is weighted by mass
+    QVector<qreal> mass;
+
+    // Parameters
+    qreal equilibriumDistance;
+    RepulsionMode repulsionMode;
+    qreal openingAngle;
+    int threadCount;
+    // Number of bodies the repulsion is normalized by (~1/N), all free bodies (or their total mass) if 0
+    // NOTE: A local layout only holds a part of the graph but keeps the normalization of the whole graph
+    int bodyCount;
+    // Maximum displacement of a body in one iteration
+    qreal temperature;
+    // If set, every free body moves exactly by the temperature along its force (instead of at most)
+    bool unitSteps;
+    // MULTILEVEL_LAYOUT computes a complete layout from scratch, all other modes perform one iteration
+    LayoutMode layoutMode;
+};
+
+class ForceLayoutTask;
+
+/*
+    Force based placement similar to Graph Drawing by Force-directed Placement (Fruchterman & Reingold)
+*/
+class ForceLayout
+{
+    public:
+        ForceLayout();
+        ~ForceLayout();
+
+        // Performs one layout iteration on the snapshot and stores the new positions in resultX/resultY
+        // Returns the energy of the iteration, i.e. the summed length of all displacements (or forces if unit steps are used)
+        qreal iterate(const LayoutSnapshot& snapshot, QVector<qreal>& resultX, QVector<qreal>& resultY);
+
+        // Number of threads sharing the force computation
+        void setThreadCount(const int count);
+        int threadCount() const { return mTasks.size(); }
+
+    protected:
+        friend class ForceLayoutTask;
+
+        // Computes the share of a single task: a share of the free bodies is repelled and a contiguous range of springs
+        // is evaluated. Exact repulsion and spring forces are accumulated in the local buffers of the task.
+        void computeForces(const int task, const int tasks);
+
+        const LayoutSnapshot* mpSnapshot;
+        QThreadPool mPool;
+        QVector<ForceLayoutTask*> mTasks;
+        QVector< QVector<qreal> > mLocalDisplacementsX;
+        QVector< QVector<qreal> > mLocalDisplacementsY;
+        QVector< QVector<qreal> > mLocalRepulsionX;
+        QVector< QVector<qreal> > mLocalRepulsionY;
+
+        // Free (not pinned) bodies, their positions and the repulsion acting on them
+        QVector<int>     mFreeBodies;
+        QVector<qreal>   mFreeX;
+        QVector<qreal>   mFreeY;
+        QVector<qreal>   mFreeMass;
+        qreal            mNormalization;
+        QVector<qreal>   mRepulsionX;
+        QVector<qreal>   mRepulsionY;
+        QuadTree         mQuadTree;
+};
+
+/*
+    Runs ForceLayout::iterate (or MultilevelLayout::compute) on a background thread.
+    The GUI thread submits snapshots and fetches finished positions which are published through a double buffer.
+*/
+class ForceLayoutWorker : public QThread
+{
+    public:
+        ForceLayoutWorker(QObject *parent = 0);
+        ~ForceLayoutWorker();
+
+        // Hands a new snapshot to the worker. Returns false if the worker is still busy with the previous one.
+        bool submit(const LayoutSnapshot& snapshot);
+        // Returns true while a snapshot is being processed or its result has not been fetched yet
+        // NOTE: Submitting only if not busy keeps the submitter in lock-step with the worker, so no result is ever skipped
+        bool isBusy();
+        // Takes the positions (and the energy) of the last finished snapshot. Returns false if there are no new positions.
+        bool fetch(QVector<qreal>& x, QVector<qreal>& y, qreal& energy);
+        // Tells the thread to finish and waits for it
+        void stop();
+
+    protected:
+        void run();
+
+        QMutex         mMutex;
+        QWaitCondition mCondition;
+        LayoutSnapshot mSnapshot;
+        bool           mHasSnapshot;
+        bool           mBusy;
+        bool           mHasResult;
+        bool           mStop;
+
+        // Double buffer: the worker writes into the back buffer while the front buffer can be fetched
+        QVector<qreal> mBuffersX[2];
+        QVector<qreal> mBuffersY[2];
+        qreal          mEnergies[2];
+        int            mFront;
+
+        ForceLayout      mLayout;
+        MultilevelLayout mMultilevel;
+};
+
+#endif
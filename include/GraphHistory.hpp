@@ -0,0 +1,59 @@
+#ifndef _GRAPH_HISTORY_HPP
+#define _GRAPH_HISTORY_HPP
+
+#include <QUndoCommand>
+#include <QVector>
+#include "Hyperedge.hpp"
+
+class HypergraphScene;
+
+// The state of a single hyperedge including the edges pointing to it
+struct EdgeState
+{
+    UniqueId    id;
+    bool        exists;
+    std::string label;
+    Hyperedges  from;
+    Hyperedges  to;
+    // Other edges pointing from/to this one
+    Hyperedges  incomingFrom;
+    Hyperedges  incomingTo;
+};
+
+// The label of a single hyperedge before and after an edit
+struct LabelChange
+{
+    UniqueId    id;
+    std::string before;
+    std::string after;
+};
+
+/*
+    An undoable edit of the graph of a HypergraphScene.
+    Only the states of the touched edges before and after the edit are stored, never the whole graph.
+    Consecutive relabelings of the same edges within one label edit session (e.g. while typing) are merged into one command.
+*/
+class GraphDelta : public QUndoCommand
+{
+    public:
+        GraphDelta(HypergraphScene *scene, const QString& text, const QVector<EdgeState>& before, const QVector<EdgeState>& after);
+        GraphDelta(HypergraphScene *scene, const QString& text, const QVector<LabelChange>& labels, const int session);
+        ~GraphDelta();
+
+        void undo();
+        void redo();
+        int id() const;
+        bool mergeWith(const QUndoCommand *other);
+
+    protected:
+        HypergraphScene     *mpScene;
+        QVector<EdgeState>   mBefore;
+        QVector<EdgeState>   mAfter;
+        QVector<LabelChange> mLabels;
+        // Label edit session of the relabeling (only relabelings of the same session are merged)
+        int                  mSession;
+        // The edit has already been applied when the command gets pushed
+        bool                 mApplied;
+};
+
+#endif
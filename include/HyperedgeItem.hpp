@@ -3,17 +3,37 @@
 
 #include <QGraphicsTextItem>
 #include <QSet>
+#include <QHash>
+#include <QPair>
 #include "Hyperedge.hpp"
 
 class EdgeItem;
 class QGraphicsTextItem;
 
+// Values of QGraphicsItem::type() of our items
+// NOTE: All hyperedge items come before all edge items (see toHyperedgeItem() and toEdgeItem())
+enum ItemTypeId {
+    HYPEREDGE_ITEM = QGraphicsItem::UserType + 1,
+    CONCEPTGRAPH_ITEM,
+    COMMONCONCEPTGRAPH_ITEM,
+    EDGE_ITEM = QGraphicsItem::UserType + 16,
+    COMMONCONCEPTGRAPH_EDGE_ITEM,
+    LAST_ITEM = QGraphicsItem::UserType + 32
+};
+
 class HyperedgeItem : public QGraphicsTextItem
 {
     public:
+        enum { Type = HYPEREDGE_ITEM };
+
         HyperedgeItem(const UniqueId& uid);
         virtual ~HyperedgeItem();
 
+        int type() const
+        {
+            return Type;
+        }
+
         void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
                    QWidget *widget);
 
@@ -33,11 +53,18 @@ class HyperedgeItem : public QGraphicsTextItem
         // Change the label
         void setLabel(const QString& l);
 
-        QSet<EdgeItem*> getEdgeItems()
+        // NOTE: Copy the set before deleting or deregistering edge items while iterating over it
+        const QSet<EdgeItem*>& getEdgeItems() const
         {
             return mEdgeSet;
         }
 
+        // Returns the edge item of the given type (see EdgeItem::Type) from this item to target or NULL
+        EdgeItem* findEdgeItem(HyperedgeItem* target, const int type) const
+        {
+            return mOutgoing.value(qMakePair(target, type), NULL);
+        }
+
         QPointF centerPos();
 
     protected:
@@ -46,6 +73,8 @@ class HyperedgeItem : public QGraphicsTextItem
 
         UniqueId edgeId;
         QSet<EdgeItem*> mEdgeSet;
+        // Index of all edge items starting at this item by (target item, type)
+        QHash< QPair<HyperedgeItem*, int>, EdgeItem*> mOutgoing;
 
         /*last pos added*/
         QPointF lastPosUsed;
@@ -62,6 +91,12 @@ class EdgeItem : public QGraphicsItem
         EdgeItem(HyperedgeItem *from, HyperedgeItem *to, const Type type=TO);
         virtual ~EdgeItem();
 
+        // NOTE: EdgeItem::Type is the direction, so the item type is EDGE_ITEM
+        int type() const
+        {
+            return EDGE_ITEM;
+        }
+
         QRectF boundingRect() const;
 
         void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
@@ -90,11 +125,29 @@ class EdgeItem : public QGraphicsItem
         }
 
     protected:
+        /*Callback to inform the scene when the item got hidden or shown*/
+        virtual QVariant itemChange(GraphicsItemChange change, const QVariant& value);
+
         HyperedgeItem* mpSourceEdge;
         HyperedgeItem* mpTargetEdge;
         Type mType;
 };
 
+// Cheap replacements of dynamic_cast for all (derived) hyperedge and edge items; return NULL for other items
+inline HyperedgeItem* toHyperedgeItem(QGraphicsItem* item)
+{
+    if (!item || (item->type() < HYPEREDGE_ITEM) || (item->type() >= EDGE_ITEM))
+        return NULL;
+    return static_cast<HyperedgeItem*>(item);
+}
+
+inline EdgeItem* toEdgeItem(QGraphicsItem* item)
+{
+    if (!item || (item->type() < EDGE_ITEM) || (item->type() >= LAST_ITEM))
+        return NULL;
+    return static_cast<EdgeItem*>(item);
+}
+
 #endif
 
 
@@ -18,6 +18,17 @@ class HypergraphControl : public QWidget
         HypergraphControl(QWidget *parent = 0);
         ~HypergraphControl();
 
+        // Shows the given seed (0 means random)
+        void setSeedValue(int seed);
+
+        // Current layout settings (e.g. for newly created viewers)
+        qreal equilibriumDistance() const;
+        RepulsionMode repulsionMode() const;
+        qreal openingAngle() const;
+        int threadCount() const;
+        LayoutMode layoutMode() const;
+        int localHops() const;
+
     signals:
         // Signals emitted by Buttons or something else
         void newHypergraph(HypergraphType type);
@@ -25,6 +36,12 @@ class HypergraphControl : public QWidget
         void loadHypergraph(HypergraphType type);
         void storeHypergraph();
         void setEquilibriumDistance(qreal distance);
+        void setRepulsionMode(RepulsionMode mode);
+        void setOpeningAngle(qreal theta);
+        void setThreadCount(int count);
+        void setLayoutMode(LayoutMode mode);
+        void setLocalHops(int hops);
+        void setSeed(int seed);
 
     public slots:
         // To be autoconnected
@@ -35,6 +52,12 @@ class HypergraphControl : public QWidget
 
         void on_equiSlider_valueChanged(int value);
         void on_equiBox_valueChanged(int value);
+        void on_repulsionBox_currentIndexChanged(int index);
+        void on_thetaBox_valueChanged(double value);
+        void on_threadBox_valueChanged(int value);
+        void on_layoutModeBox_currentIndexChanged(int index);
+        void on_hopBox_valueChanged(int value);
+        void on_seedBox_valueChanged(int value);
 
     private:
         Ui::HypergraphControl *mpUi;
@@ -13,6 +13,7 @@ namespace Ui
 // Forward declarations
 class QTabWidget;
 class HypergraphControl;
+class HypergraphViewer;
 
 class HypergraphGUI : public QMainWindow
 {
@@ -28,9 +29,23 @@ class HypergraphGUI : public QMainWindow
         void loadHypergraphRequest(HypergraphType type);
         void storeHypergraphRequest();
         void onYAMLStringReady(const QString& yamlString);
+        // Writes the node positions next to the last saved file
+        void onPositionsYAMLReady(const QString& yamlString);
         void setEquilibriumDistanceRequest(qreal distance);
+        void setRepulsionModeRequest(RepulsionMode mode);
+        void setOpeningAngleRequest(qreal theta);
+        void setThreadCountRequest(int count);
+        void setLayoutModeRequest(LayoutMode mode);
+        void setLocalHopsRequest(int hops);
+        // A seed > 0 makes all new viewers deterministic (placement, Z order and layout)
+        void setSeedRequest(int seed);
 
     private:
+        // Reseeds qrand() before a new viewer gets created (if a seed is set)
+        void reseed();
+        // Hands the current settings of the control (and the seed) to a new viewer
+        void applySettings(HypergraphViewer* viewer);
+
         Ui::HypergraphGUI* mpUi;
 
         // The tab widget holding all viewers
@@ -40,6 +55,7 @@ class HypergraphGUI : public QMainWindow
         HypergraphControl* mpControl;
         QString lastOpenedFile;
         QString lastSavedFile;
+        int mSeed;
 };
 
 #endif
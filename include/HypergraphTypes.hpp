@@ -7,4 +7,15 @@ typedef enum {
     COMMONCONCEPTGRAPH
 } HypergraphType;
 
+typedef enum {
+    EXACT_REPULSION,
+    BARNES_HUT_REPULSION
+} RepulsionMode;
+
+typedef enum {
+    SINGLE_LEVEL_LAYOUT,
+    MULTILEVEL_LAYOUT,
+    LOCAL_LAYOUT
+} LayoutMode;
+
 #endif
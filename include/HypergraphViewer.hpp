@@ -4,8 +4,16 @@
 #include <QWidget>
 #include <QGraphicsView>
 #include <QMap>
+#include <QSet>
+#include <QHash>
+#include <QLinkedList>
+#include <set>
 #include "Hyperedge.hpp"
 #include "Hypergraph.hpp"
+#include "HypergraphTypes.hpp"
+#include "ForceLayout.hpp"
+#include "GraphHistory.hpp"
+#include "UidIndex.hpp"
 
 // Generated by MOC
 namespace Ui
@@ -16,9 +24,12 @@ namespace Ui
 // Forward decls
 class QGraphicsScene;
 class QGraphicsView;
+class QLabel;
+class QUndoStack;
 
 class Hyperedge;
 class HyperedgeItem;
+class EdgeItem;
 
 class HypergraphScene : public QGraphicsScene
 {
@@ -32,44 +43,168 @@ class HypergraphScene : public QGraphicsScene
         void removeItem(QGraphicsItem *item);
         Hyperedges getAllEdges()
         {
-            return currentGraph.findByLabel();
+            return graph().findByLabel();
         }
+        // NOTE: Derived scenes share this graph and provide typed views of it
         Hypergraph& graph()
         {
-            return currentGraph;
+            return *mpGraph;
         }
         bool isEnabled() { return mEnabled; }
         virtual bool isLayoutEnabled() { return false; }
+        // Called whenever items get added, removed, hidden, shown or reparented
+        virtual void invalidateLayoutGraph() {}
+        // Returns the selected items (in the order they got selected)
         QList<HyperedgeItem*> selectedHyperedgeItems();
 
+        // Registry of all hyperedge items of this scene (kept up to date by addItem() & removeItem())
+        // NOTE: Use it instead of items() and casting every item
+        const QSet<HyperedgeItem*>& hyperedgeItems() const { return mHyperedgeItems; }
+        // Called by the items when they get (de)selected or destroyed
+        void itemSelected(HyperedgeItem *item, const bool selected);
+        void itemDestroyed(HyperedgeItem *item);
+        void itemDestroyed(EdgeItem *item);
+        // Called by lines before they get detached from their items (e.g. because one of them is removed)
+        virtual void itemDetached(EdgeItem *item) {}
+
+        // Between beginBulkUpdate() and endBulkUpdate() (which may be nested) added items do not emit
+        // edgeAdded, edgesConnected & itemAdded. Instead, the final endBulkUpdate() emits itemsAdded() once.
+        // NOTE: Removals are still signalled per item
+        void beginBulkUpdate();
+        void endBulkUpdate();
+        bool isBulkUpdating() { return mBulkDepth > 0; }
+        // True while the items of a full load (or import) are created, until the outermost bulk update ends
+        bool isFullLoad() { return mFullLoad; }
+
+        // Undo/redo history of all edits done through the slots of this (or a derived) scene
+        QUndoStack* undoStack() { return mpUndoStack; }
+        // Starts a new label edit (e.g. typing into the selection): relabelings are only merged within the same session
+        void beginLabelSession() { mLabelSession++; }
+        // Used by GraphDelta to undo/redo edits (nothing gets recorded)
+        void restoreEdges(const QVector<EdgeState>& states);
+        void restoreLabel(const UniqueId& id, const std::string& label);
+
+    protected:
+        // Derived scenes pass their (typed) graph which is then used by all layers of the scene
+        // If graph is NULL, a plain hypergraph is created and owned by this scene
+        HypergraphScene(Hypergraph* graph, QObject * parent);
+
     signals:
         // Signals emitted
         void edgeAdded(const UniqueId id);
         void edgeRemoved(const UniqueId id);
         void edgesConnected(const UniqueId fromId, const UniqueId toId);
         void itemAdded(QGraphicsItem *item);
+        // Summary of a bulk update
+        void itemsAdded(const QList<QGraphicsItem*>& items);
 
     public slots:
         // This is the constructing function of the hyperedge scene
+        // Only the edges touched since the last call are updated (unless a resync is pending)
         virtual void visualize();
+        // Merges the graph and resyncs the whole scene
         virtual void visualize(const Hypergraph& graph);
+        // Fallback: Compares all edges of the graph with all items on the next visualize() call
+        void resync();
         // Enable visualization
         virtual void setEnabled(bool enable) { mEnabled = enable; }
         // Enable layouting
         virtual void setLayoutEnabled(bool enable) {}
         virtual void updateLayout() {}
+        virtual void restartGlobalLayout() {}
         virtual void setEquilibriumDistance(qreal distance) {}
+        virtual void setRepulsionMode(RepulsionMode mode) {}
+        virtual void setOpeningAngle(qreal theta) {}
+        virtual void setThreadCount(int count) {}
+        virtual void setLayoutMode(LayoutMode mode) {}
+        virtual void setLocalHops(int hops) {}
+        // Makes incremental work independent of timing (e.g. if a seed is set)
+        virtual void setDeterministic(bool enable) {}
 
         // Slots to modify the underlying hyperedge system
         void addEdge(const UniqueId id, const QString& label="");
         void removeEdge(const UniqueId id);
         void connectEdges(const UniqueId fromId, const UniqueId id, const UniqueId toId);
         void updateEdge(const UniqueId id, const QString& label);
+        // Relabels the edges in the graph right away, but refreshes their items at most once per frame
+        void updateEdges(const Hyperedges& ids, const QString& label);
+        // Refreshes the items of all edges relabeled since the last call
+        void refreshLabels();
 
     protected:
+        // Sets the text of the item from the graph
+        virtual void refreshLabel(HyperedgeItem *item);
+        // Makes the items of the given edges match the graph again (after undo/redo)
+        virtual void refreshEdges(const Hyperedges& ids);
+        // Called whenever an edit, undo or redo changed the given edges (including the edges they point or pointed to)
+        virtual void edgesChanged(const Hyperedges& ids) {}
+
+        // Call beginEdit() before and endEdit() after changing the graph to record an undoable edit
+        void beginEdit(const Hyperedges& ids);
+        // Records edges created by the edit whose ids were not known in advance (call it before endEdit())
+        // NOTE: Edges pointing from new edges (e.g. the facts of a new instance) are new as well and get recorded, too
+        void recordNew(const Hyperedges& ids);
+        void endEdit(const QString& text);
+        // Records the relabeling of the given edges (call it before changing them)
+        void recordLabels(const Hyperedges& ids, const QString& label);
+        // Returns the states of the given edges (including the edges pointing to them)
+        QVector<EdgeState> captureStates(const Hyperedges& ids);
+        // Appends the edges affected by a change of the given state: the edges it points from and to,
+        // the edges pointing to it and the edges these point from and to
+        void collectAffected(const EdgeState& state, Hyperedges& affected);
+
+        // Records an edge which has been created, destroyed, relabeled or (re)connected
+        void touch(const UniqueId& id);
+        // Returns the item of an edge (or NULL)
+        HyperedgeItem* itemOf(const UniqueId& id) const;
+        HyperedgeItem* itemAtIndex(const UidIndex::Index index) const
+        {
+            return (index < (UidIndex::Index)currentItems.size()) ? currentItems.at(index) : NULL;
+        }
+        // Stores the item of an edge (or forgets it if item is NULL)
+        void setItemOf(const UniqueId& id, HyperedgeItem *item)
+        {
+            setItemAtIndex(mUids.intern(id), item);
+        }
+        void setItemAtIndex(const UidIndex::Index index, HyperedgeItem *item);
+        // Full resync of all items with the graph
+        void synchronize();
+        // Updates the label of the item and creates missing connections to other items
+        void wire(HyperedgeItem *srcItem);
+        // Deletes the item of the edge and all its connections
+        void removeHyperedgeItem(const UniqueId& id);
+        // Drops an item from the pending bulk summary
+        void forgetBulkItem(QGraphicsItem *item);
+
         bool mEnabled;
-        Hypergraph currentGraph;
-        QMap<UniqueId, HyperedgeItem*> currentItems;
+        // The one and only graph of the scene hierarchy (owned by this scene if mOwnsGraph is set)
+        Hypergraph* mpGraph;
+        bool mOwnsGraph;
+        // All edges seen by the scene get a dense index, which is used by all scene-side lookups
+        // currentItems holds the item of every index (or NULL)
+        UidIndex mUids;
+        QVector<HyperedgeItem*> currentItems;
+        // Change journal: edges touched since the last visualize() call
+        std::set<UidIndex::Index> mJournal;
+        bool mResyncPending;
+        // Items relabeled by updateEdges() which still have to be refreshed
+        std::set<UidIndex::Index> mPendingLabels;
+        QTimer *mpLabelTimer;
+        // History and the edit currently being recorded
+        QUndoStack *mpUndoStack;
+        Hyperedges mEditIds;
+        QVector<EdgeState> mEditBefore;
+        int mLabelSession;
+        // Bulk update nesting & items added meanwhile (in insertion order)
+        int mBulkDepth;
+        bool mFullLoad;
+        QList<QGraphicsItem*> mBulkItems;
+        QSet<QGraphicsItem*> mBulkItemSet;
+        // Typed registries of our items
+        QSet<HyperedgeItem*> mHyperedgeItems;
+        // Selected items in the order they got selected & their positions in that list
+        QLinkedList<HyperedgeItem*> mSelectedItems;
+        QHash<HyperedgeItem*, QLinkedList<HyperedgeItem*>::iterator> mSelectedPositions;
 };
 
 class ForceBasedScene : public HypergraphScene
@@ -81,19 +216,97 @@ class ForceBasedScene : public HypergraphScene
         ~ForceBasedScene();
 
         virtual bool isLayoutEnabled();
+        // Returns true if the layout has settled and the timer has been stopped
+        bool isLayoutConverged() { return mLayoutEnabled && !mpTimer->isActive(); }
+        // Drops the cached layout graph, it will be rebuilt on the next layout tick
+        void invalidateLayoutGraph();
+        // Marks the ends of a removed line dirty (for local layout)
+        void itemDetached(EdgeItem *item);
+
+    protected:
+        // See HypergraphScene
+        ForceBasedScene(Hypergraph* graph, QObject * parent);
+
+    signals:
+        // Emitted after every layout iteration
+        void layoutUpdated(qreal energy, unsigned int iterations);
 
     public slots:
-        // Cycles through all items of a scene and updates the positions of hyperedgeitems according to their neighbours
+        // Applies the positions computed by the layout worker and hands it a new snapshot of the current scene
         virtual void updateLayout();
+        // Reheats the layout and restarts the timer (if layouting is enabled)
+        void restartLayout();
+        // Like restartLayout() but only warms the layout up to a small refinement temperature
+        void resumeLayout();
+        // Like restartLayout() but also schedules a new multilevel layout (if selected)
+        // NOTE: Only used after a complete load or on request (e.g. switching modes), edits are refined in place
+        virtual void restartGlobalLayout();
         virtual void setEquilibriumDistance(qreal distance);
+        // Select between exact (all pairs) and Barnes-Hut (quadtree) repulsion
+        virtual void setRepulsionMode(RepulsionMode mode);
+        // Opening angle of the Barnes-Hut approximation (smaller is more exact)
+        virtual void setOpeningAngle(qreal theta);
+        // Number of threads sharing the force computation of a layout iteration
+        virtual void setThreadCount(int count);
+        // Select between single level refinement, multilevel (coarsen & refine) and local layout
+        virtual void setLayoutMode(LayoutMode mode);
+        // Size of the neighbourhood (in hops) which is relaxed around edited items in local layout mode
+        virtual void setLocalHops(int hops);
+        // Remember edited items for local layout
+        void markDirty(const UniqueId id);
+        void markDirty(const UniqueId fromId, const UniqueId toId);
+        void markDirty(const QList<QGraphicsItem*>& items);
         // Enable visualization (and also Timer!)
         virtual void setEnabled(bool enable);
         // Only enable/disable layouting
         virtual void setLayoutEnabled(bool enable);
 
     protected:
+        // Adapts the temperature to the progress made in the last iteration
+        void coolDown(const qreal energy);
+        // Rebuilds the cached layout graph from all visible top level items
+        void rebuildLayoutGraph();
+        // Fill mJob & mJobItems with all items of the (cached) layout graph
+        void buildSnapshot();
+        // Fill mJob & mJobItems with the neighbourhood of all dirty items only
+        void buildLocalSnapshot();
+
         QTimer *mpTimer;
+        bool mLayoutEnabled;
         qreal mEquilibriumDistance;
+        RepulsionMode mRepulsionMode;
+        qreal mOpeningAngle;
+        int mThreadCount;
+        LayoutMode mLayoutMode;
+        // Set if the next snapshot shall be layouted by the multilevel engine
+        bool mMultilevelPending;
+        // Items edited since the local layout settled last
+        std::set<UidIndex::Index> mDirtyIds;
+        int mLocalHops;
+
+        // Cooling schedule & convergence
+        qreal mTemperature;
+        qreal mEnergy;
+        unsigned int mIterations;
+        unsigned int mProgress;
+
+        // The force computation runs on a worker thread
+        ForceLayoutWorker *mpWorker;
+        // The snapshot currently processed by the worker, the items of its bodies
+        // and the revision of the layout graph it has been built from
+        LayoutSnapshot mJob;
+        QVector<HyperedgeItem*> mJobItems;
+        unsigned int mJobRevision;
+        QVector<qreal> mResultX;
+        QVector<qreal> mResultY;
+
+        // Cached layout graph: a dense index of all visible top level items
+        // and the springs between them in compressed rows (children are represented by their parents)
+        bool mLayoutGraphValid;
+        unsigned int mLayoutGraphRevision;
+        QVector<HyperedgeItem*> mLayoutNodes;
+        QVector<int> mLayoutOffsets;
+        QVector<int> mLayoutTargets;
 };
 
 class HypergraphView : public QGraphicsView
@@ -106,7 +319,13 @@ class HypergraphView : public QGraphicsView
 
         HypergraphScene* scene()
         {
-            return dynamic_cast<HypergraphScene*>(QGraphicsView::scene());
+            // NOTE: The scene is only cast again if it has been replaced
+            if (QGraphicsView::scene() != mpCachedScene)
+            {
+                mpCachedScene = QGraphicsView::scene();
+                mpHypergraphScene = dynamic_cast<HypergraphScene*>(mpCachedScene);
+            }
+            return mpHypergraphScene;
         }
 
     protected:
@@ -118,6 +337,11 @@ class HypergraphView : public QGraphicsView
         // Mouse press and release event to move view
         void mousePressEvent(QMouseEvent*);
         void mouseReleaseEvent(QMouseEvent*);
+
+    private:
+        // The scene the typed pointer has been cast from
+        QGraphicsScene  *mpCachedScene;
+        HypergraphScene *mpHypergraphScene;
 };
 
 class HypergraphEdit : public HypergraphView
@@ -169,6 +393,8 @@ class HypergraphViewer : public QWidget
     signals:
         // Will be emitted by storeToYAML if generation is finished
         void YAMLStringReady(const QString& yamlString);
+        // Will be emitted by storeToYAML with the positions of all top level items (uid: [x, y])
+        void positionsYAMLReady(const QString& yamlString);
 
     public slots:
         // Load a hyperedge system (= hypergraph) from YAML file
@@ -178,13 +404,27 @@ class HypergraphViewer : public QWidget
         void loadFromGraph(const Hypergraph& graph);
         // Store a hyperedge system (= hypergraph) to a YAML string
         void storeToYAML();
+        // Load positions (uid: [x, y]) which will be used instead of the default placement of new items
+        // A missing or broken file is ignored
+        void loadPositionsFromYAMLFile(const QString& fileName);
         // Clear everything
         void clearHypergraph();
         // Change the equilibrium distance for force based layout
         void setEquilibriumDistance(qreal distance);
+        // Change the repulsion model and its parameters for force based layout
+        void setRepulsionMode(RepulsionMode mode);
+        void setOpeningAngle(qreal theta);
+        void setThreadCount(int count);
+        void setLayoutMode(LayoutMode mode);
+        void setLocalHops(int hops);
+        void setDeterministic(bool enable);
         // A slot which can be called whenever the graph has changed
-        void onGraphChanged(const UniqueId id);
+        virtual void onGraphChanged(const UniqueId id);
         void onGraphChanged(QGraphicsItem* item);
+        // Places all items of a bulk update in one pass and updates the stats once
+        virtual void onItemsAdded(const QList<QGraphicsItem*>& items);
+        // A slot which can be called whenever the layout has been updated
+        void onLayoutUpdated(qreal energy, unsigned int iterations);
 
     protected:
         // Triggered when widget is about to get visible
@@ -192,6 +432,16 @@ class HypergraphViewer : public QWidget
         // Triggered when widget is about to get hidden
         void hideEvent(QHideEvent *event);
 
+        // The label showing graph & layout statistics
+        virtual QLabel* statsLabel();
+        // Writes mGraphStats and mLayoutStats to the stats label
+        void updateStats();
+        // Moves the item to its stored position (if there is one). Returns true on success.
+        bool restorePosition(HyperedgeItem* item);
+        QMap<UniqueId, QPointF> mStoredPositions;
+        QString mGraphStats;
+        QString mLayoutStats;
+
         Ui::HypergraphViewer* mpUi;
 
         HypergraphScene*     mpScene;
@@ -0,0 +1,55 @@
+#ifndef _MULTILEVEL_LAYOUT_HPP
+#define _MULTILEVEL_LAYOUT_HPP
+
+#include <QVector>
+
+struct LayoutSnapshot;
+class ForceLayout;
+
+/*
+    Multilevel force based placement similar to A Multilevel Algorithm for Force-Directed Graph Drawing (Walshaw)
+    The graph is coarsened by matching (or collapsing) neighbouring bodies until only a few bodies are left.
+    The coarsest graph is layouted first, then the positions are interpolated and refined level by level.
+    All levels are refined with Barnes-Hut repulsion, so large graphs settle within a few seconds.
+*/
+class MultilevelLayout
+{
+    public:
+        MultilevelLayout();
+        ~MultilevelLayout();
+
+        // Computes a complete layout of the snapshot (from its current positions) and stores it in resultX/resultY
+        // Pinned bodies are never merged and keep their positions. Returns the energy of the last refinement iteration.
+        qreal compute(const LayoutSnapshot& snapshot, ForceLayout& layout, QVector<qreal>& resultX, QVector<qreal>& resultY);
+
+    protected:
+        struct Level
+        {
+            QVector<qreal> x;
+            QVector<qreal> y;
+            QVector<bool>  pinned;
+            QVector<int>   edgeSources;
+            QVector<int>   edgeTargets;
+            QVector<int>   mass;     // number of original bodies represented by a body
+            QVector<int>   parent;   // index of the body in the next coarser level
+            qreal          equilibriumDistance;
+        };
+
+        // Builds the next coarser level of fine (and sets fine.parent)
+        void coarsen(Level& fine, Level& coarse);
+        // Places the bodies of fine around their parents in coarse
+        void prolong(const Level& coarse, Level& fine);
+        // Runs (at most) the given number of iterations on a level with an adaptive step length
+        qreal refine(Level& level, LayoutSnapshot& job, ForceLayout& layout, const int iterations, const qreal step);
+
+        QVector<Level>   mLevels;
+        // Adjacency of the level being coarsened (compressed rows)
+        QVector<int>     mOffsets;
+        QVector<int>     mNeighbours;
+        QVector<int>     mOrder;
+        QVector<quint64> mEdgeKeys;
+        QVector<qreal>   mResultX;
+        QVector<qreal>   mResultY;
+};
+
+#endif
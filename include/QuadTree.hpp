@@ -0,0 +1,46 @@
+#ifndef _QUAD_TREE_HPP
+#define _QUAD_TREE_HPP
+
+#include <QPointF>
+#include <QVector>
+
+/*
+    A Barnes-Hut quadtree over a set of point charges.
+    After build(), repulsion() approximates the summed repulsive displacement acting on one body
+    by treating far away cells (cell size / distance < theta) as a single charge at their center of mass.
+*/
+class QuadTree
+{
+    public:
+        QuadTree();
+        ~QuadTree();
+
+        // (Re-)Build the tree for the given positions and masses (unit masses if empty)
+        void build(const QVector<qreal>& x, const QVector<qreal>& y, const QVector<qreal>& mass = QVector<qreal>());
+
+        // Returns the repulsive displacement acting on body i (without 1/N scaling)
+        // Cells which are farther away than 10 * equilibriumDistance are skipped (same cutoff as the exact model)
+        QPointF repulsion(const int i, const qreal equilibriumDistance, const qreal theta) const;
+
+    protected:
+        struct Node
+        {
+            QPointF center;         // geometric center of the cell
+            qreal   halfSize;       // half of the edge length of the cell
+            QPointF centerOfMass;   // sum of positions while building, average afterwards
+            qreal   mass;           // summed mass of the bodies in this cell
+            int     count;          // number of bodies in this cell
+            int     body;           // index of the body if this is a leaf holding exactly one body, -1 otherwise
+            int     children[4];    // indices of child cells, -1 if not present
+        };
+
+        int  createNode(const QPointF& center, const qreal halfSize);
+        void insert(const int i);
+
+        QVector<Node>    mNodes;
+        QVector<qreal>   mX;
+        QVector<qreal>   mY;
+        QVector<qreal>   mMass;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _UID_INDEX_HPP
+#define _UID_INDEX_HPP
+
+#include <QtGlobal>
+#include <unordered_map>
+#include <vector>
+#include "Hyperedge.hpp"
+
+/*
+    Interning table for UniqueIds.
+    Every UniqueId gets a dense 32 bit index once, so scene-side lookups and sets can use plain integers
+    (e.g. as vector indices) instead of comparing long strings.
+    NOTE: Indices are never reused, so they stay valid as long as the table lives
+*/
+class UidIndex
+{
+    public:
+        typedef quint32 Index;
+        static const Index NONE = 0xffffffff;
+
+        UidIndex();
+        ~UidIndex();
+
+        // Returns the index of the uid (a new one if the uid is unknown)
+        Index intern(const UniqueId& uid);
+        // Returns the index of the uid or NONE if it is unknown
+        Index find(const UniqueId& uid) const;
+        // Returns the uid of a valid index
+        const UniqueId& uid(const Index index) const
+        {
+            return *mUids[index];
+        }
+        Index size() const
+        {
+            return mUids.size();
+        }
+
+    protected:
+        // Copies would point to the keys of the original
+        Q_DISABLE_COPY(UidIndex)
+
+        std::unordered_map<UniqueId, Index> mIndices;
+        // Points to the keys of mIndices, so every uid is stored only once
+        // NOTE: The nodes of an unordered_map never move (not even on rehash)
+        std::vector<const UniqueId*> mUids;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef _UID_LIST_MODEL_HPP
+#define _UID_LIST_MODEL_HPP
+
+#include <QAbstractListModel>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include "Hyperedge.hpp"
+
+/*
+    A list of UIDs which is changed incrementally.
+    Insertions and removals are queued and applied together in the next event loop iteration,
+    so thousands of changes in a row cause only one update of the attached views.
+*/
+class UidListModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+    public:
+        UidListModel(QObject *parent = 0);
+        ~UidListModel();
+
+        int rowCount(const QModelIndex& parent = QModelIndex()) const;
+        QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const;
+
+    public slots:
+        // Queue a single change
+        void insert(const UniqueId uid);
+        void remove(const UniqueId uid);
+        // Queue the changes needed to turn the current list into uids
+        void assign(const Hyperedges& uids);
+        // Apply all queued changes now
+        void flush();
+
+    protected:
+        // Schedules flush() (once)
+        void scheduleFlush();
+
+        QStringList mUids;
+        QHash<QString, int> mRows;
+        // Queued changes (insertions keep their order, mPendingInsertSet tells which of them are still valid)
+        QStringList mPendingInserts;
+        QSet<QString> mPendingInsertSet;
+        QSet<QString> mPendingRemoves;
+        bool mFlushPending;
+};
+
+#endif
@@ -2,12 +2,15 @@
 #include "ui_CommonConceptGraphViewer.h"
 #include "ui_HypergraphViewer.h"
 #include "CommonConceptGraphItem.hpp"
+#include "UidListModel.hpp"
 
 #include <QGraphicsScene>
 #include <QWheelEvent>
 #include <QTimer>
 #include <QtCore>
 #include <QInputDialog>
+#include <QUndoStack>
+#include <QElapsedTimer>
 
 #include "Hypergraph.hpp"
 #include "Conceptgraph.hpp"
@@ -15,29 +18,41 @@
 #include "HypergraphYAML.hpp"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+
+// Time budget of a single sync slice (in ms) ...
+#define SYNC_BUDGET_MS 4
+// ... and the interval between two slices (in ms)
+#define SYNC_INTERVAL_MS 40
+// Number of concepts of a single sync slice if the sync has to be deterministic
+#define SYNC_STEP_CONCEPTS 64
 
 CommonConceptGraphScene::CommonConceptGraphScene(QObject * parent)
-: ConceptgraphScene(parent)
+: ConceptgraphScene(new CommonConceptGraph(), parent)
 {
+    mpCommonConceptGraph = static_cast<CommonConceptGraph*>(mpGraph);
     mShowClasses = true;
     mShowInstances = true;
+    mSweepIndex = 0;
+    mDeterministic = false;
     mpUpdateTimer = new QTimer(this);
     connect(mpUpdateTimer, SIGNAL(timeout()), this, SLOT(updateVisualization()));
-    mpUpdateTimer->start(200);
+    // The graph already contains the basic concepts & relations
+    rebuildCategories();
 }
 
 CommonConceptGraphScene::~CommonConceptGraphScene()
 {
+    delete mpCommonConceptGraph;
 }
 
 QList<CommonConceptGraphItem*> CommonConceptGraphScene::selectedCommonConceptGraphItems()
 {
-    // get all selected hyperedge items
-    QList<QGraphicsItem *> selItems = selectedItems();
+    // get all selected items from the registry of the base scene (in the order they got selected)
     QList<CommonConceptGraphItem *> selHItems;
-    for (QGraphicsItem *item : selItems)
+    for (HyperedgeItem *item : selectedHyperedgeItems())
     {
-        CommonConceptGraphItem* hitem = dynamic_cast<CommonConceptGraphItem*>(item);
+        CommonConceptGraphItem* hitem = qgraphicsitem_cast<CommonConceptGraphItem*>(item);
         if (hitem)
             selHItems.append(hitem);
     }
@@ -48,8 +63,19 @@ void CommonConceptGraphScene::addItem(QGraphicsItem *item)
 {
     ConceptgraphScene::addItem(item);
 
-    // Emit signals
-    CommonConceptGraphItem *edge = dynamic_cast<CommonConceptGraphItem*>(item);
+    // Keep the per-type item lists up to date
+    CommonConceptGraphItem *edge = qgraphicsitem_cast<CommonConceptGraphItem*>(item);
+    if (edge)
+    {
+        if (edge->getType() == CommonConceptGraphItem::CommonConceptGraphItemType::INSTANCE)
+            mInstanceItems.insert(edge);
+        else
+            mClassItems.insert(edge);
+    }
+
+    // Emit signals (unless they are summarized by a bulk update)
+    if (isBulkUpdating())
+        return;
     if (edge)
     {
         if (edge->getType() == CommonConceptGraphItem::CommonConceptGraphItemType::INSTANCE)
@@ -62,9 +88,12 @@ void CommonConceptGraphScene::addItem(QGraphicsItem *item)
 void CommonConceptGraphScene::removeItem(QGraphicsItem *item)
 {
     // Emit signals
-    CommonConceptGraphItem *edge = dynamic_cast<CommonConceptGraphItem*>(item);
+    CommonConceptGraphItem *edge = qgraphicsitem_cast<CommonConceptGraphItem*>(item);
     if (edge)
     {
+        // NOTE: The item might have changed its classification since it got created
+        mInstanceItems.remove(edge);
+        mClassItems.remove(edge);
         if (edge->getType() == CommonConceptGraphItem::CommonConceptGraphItemType::INSTANCE)
             emit instanceRemoved(edge->getHyperEdgeId());
         else
@@ -76,27 +105,37 @@ void CommonConceptGraphScene::removeItem(QGraphicsItem *item)
 
 void CommonConceptGraphScene::addInstance(const UniqueId superId, const QString& label)
 {
+    beginEdit(Hyperedges());
     Hyperedges instances(graph().instantiateFrom(Hyperedges{superId}, label.toStdString()));
+    recordNew(instances);
+    endEdit(tr("Add instance %1").arg(label));
     for (const UniqueId& id : instances)
         visualize(id);
 }
 
 void CommonConceptGraphScene::addClass(const UniqueId id, const QString& label)
 {
+    beginEdit(Hyperedges{id});
     graph().concept(id, label.toStdString());
+    endEdit(tr("Add class %1").arg(label));
     visualize(id);
 }
 
 void CommonConceptGraphScene::addFact(const UniqueId superId, const UniqueId fromId, const UniqueId toId)
 {
+    beginEdit(Hyperedges());
     Hyperedges facts(graph().factFrom(Hyperedges{fromId}, Hyperedges{toId}, superId));
+    recordNew(facts);
+    endEdit(tr("Add fact"));
     visualize(fromId);
     visualize(toId);
 }
 
 void CommonConceptGraphScene::addRelation(const UniqueId id, const UniqueId fromId, const UniqueId toId, const QString& label)
 {
+    beginEdit(Hyperedges{id});
     graph().relate(id, Hyperedges{fromId}, Hyperedges{toId}, label.toStdString());
+    endEdit(tr("Add relation %1").arg(label));
     visualize(fromId);
     visualize(toId);
 }
@@ -104,84 +143,441 @@ void CommonConceptGraphScene::addRelation(const UniqueId id, const UniqueId from
 void CommonConceptGraphScene::removeEdge(const UniqueId id)
 {
     if (graph().exists(id))
+    {
+        beginEdit(Hyperedges{id});
         graph().destroy(id);
+        endEdit(tr("Remove %1").arg(QString::fromStdString(id)));
+    }
     visualize(id);
 }
 
 void CommonConceptGraphScene::updateEdge(const UniqueId id, const QString& label)
 {
+    // A single relabeling is never merged with others
+    beginLabelSession();
+    recordLabels(Hyperedges{id}, label);
     graph().access(id).label(label.toStdString());
     visualize(id);
 }
 
+void CommonConceptGraphScene::refreshEdges(const Hyperedges& ids)
+{
+    // Relations are drawn as lines between concepts, so these have to be rewired from scratch
+    for (const UniqueId& id : ids)
+    {
+        HyperedgeItem *item(itemOf(id));
+        if (item)
+        {
+            const QSet<EdgeItem*> lines(item->getEdgeItems());
+            for (auto line : lines)
+            {
+                if (line->getSourceItem() != item)
+                    continue;
+                line->deregister();
+                delete line;
+            }
+        }
+        visualize(id);
+    }
+}
+
 void CommonConceptGraphScene::showClasses(const bool value)
 {
     mShowClasses = value;
+    applyVisibility(mClassItems, value);
+}
+
+void CommonConceptGraphScene::setDeterministic(bool enable)
+{
+    mDeterministic = enable;
 }
 
 void CommonConceptGraphScene::showInstances(const bool value)
 {
     mShowInstances = value;
+    applyVisibility(mInstanceItems, value);
+}
+
+void CommonConceptGraphScene::applyVisibility(const QSet<CommonConceptGraphItem*>& items, const bool visible)
+{
+    // First: show or hide the items (which also shows or hides their children)
+    QList<HyperedgeItem*> affected;
+    for (CommonConceptGraphItem *item : items)
+    {
+        // NOTE: Children of hidden items are hidden as well, so compare the explicit visibility
+        if (item->isVisibleTo(item->parentItem()) == visible)
+            continue;
+        item->setVisible(visible);
+        affected.append(item);
+    }
+
+    // Second: the lines of all affected items and their children follow
+    QSet<EdgeItem*> lines;
+    for (int i = 0; i < affected.size(); ++i)
+    {
+        HyperedgeItem *item(affected.at(i));
+        for (auto line : item->getEdgeItems())
+            lines.insert(line);
+        for (QGraphicsItem *child : item->childItems())
+        {
+            HyperedgeItem *childItem(toHyperedgeItem(child));
+            if (childItem)
+                affected.append(childItem);
+        }
+    }
+    for (auto line : lines)
+        line->setVisible(line->getSourceItem()->isVisible() && line->getTargetItem()->isVisible());
 }
 
 QStringList CommonConceptGraphScene::getAllClassUIDs()
 {
     QStringList result;
-    Hyperedges allConcepts(graph().concepts());
-    Hyperedges allInstances(graph().instancesOf(allConcepts));
-    Hyperedges allClasses(subtract(allConcepts, allInstances));
-    for (const UniqueId& classUID : allClasses)
-        result.push_back(QString::fromStdString(classUID));
+    for (const UidIndex::Index index : mCategoryMembers[CLASS_CATEGORY])
+        result.push_back(QString::fromStdString(mUids.uid(index)));
     return result;
 }
 
 QStringList CommonConceptGraphScene::getAllRelationUIDs()
 {
     QStringList result;
+    for (const UidIndex::Index index : mCategoryMembers[RELATION_CLASS_CATEGORY])
+        result.push_back(QString::fromStdString(mUids.uid(index)));
+    return result;
+}
+
+Hyperedges CommonConceptGraphScene::categoryMembers(const Category category) const
+{
+    Hyperedges result;
+    result.reserve(mCategoryMembers[category].size());
+    for (const UidIndex::Index index : mCategoryMembers[category])
+        result.push_back(mUids.uid(index));
+    return result;
+}
+
+void CommonConceptGraphScene::edgesChanged(const Hyperedges& ids)
+{
+    invalidateClassification();
+    for (const UniqueId& id : ids)
+    {
+        categorize(id);
+        // Concepts (and items of vanished ones) have to be synced as well
+        // NOTE: This also covers the dependents of removed concepts, which can not be queried anymore
+        const Category category(mCategoryOf.value(mUids.intern(id), NO_CATEGORY));
+        if ((category == CLASS_CATEGORY) || (category == INSTANCE_CATEGORY) || itemOf(id))
+            queueConcept(id);
+    }
+}
+
+void CommonConceptGraphScene::categorize(const UniqueId& id)
+{
+    const UidIndex::Index index(mUids.intern(id));
+    if (!graph().exists(id))
+    {
+        setCategory(index, NO_CATEGORY);
+        return;
+    }
+
+    // Concept or relation? Known edges keep their kind.
+    // NOTE: Only relations point from or to other edges, concepts are pointed to by the basic concepts
+    const Category current(mCategoryOf.value(index, NO_CATEGORY));
+    bool isConcept;
+    if (current != NO_CATEGORY)
+        isConcept = (current == CLASS_CATEGORY) || (current == INSTANCE_CATEGORY);
+    else
+        isConcept = graph().access(id).pointingFrom().empty() && graph().access(id).pointingTo().empty();
+
+    if (isConcept)
+    {
+        Hyperedges superclassesOf(graph().instancesOf(Hyperedges{id}, "", CommonConceptGraph::TraversalDirection::FORWARD));
+        setCategory(index, superclassesOf.empty() ? CLASS_CATEGORY : INSTANCE_CATEGORY);
+        return;
+    }
+    Hyperedges superRelations(graph().factsOf(id, Hyperedges(), Hyperedges(), CommonConceptGraph::TraversalDirection::FORWARD));
+    if (!superRelations.empty())
+    {
+        setCategory(index, FACT_CATEGORY);
+        return;
+    }
+    // The origin of FACT-OF is no relation class either
+    Hyperedges excluded(graph().access(CommonConceptGraph::FactOfId).pointingFrom());
+    if (std::find(excluded.begin(), excluded.end(), id) != excluded.end())
+        setCategory(index, NO_CATEGORY);
+    else
+        setCategory(index, RELATION_CLASS_CATEGORY);
+}
+
+void CommonConceptGraphScene::setCategory(const UidIndex::Index index, const Category category)
+{
+    const Category current(mCategoryOf.value(index, NO_CATEGORY));
+    if (current == category)
+        return;
+    if (current != NO_CATEGORY)
+        mCategoryMembers[current].erase(index);
+    if (category != NO_CATEGORY)
+    {
+        mCategoryMembers[category].insert(index);
+        mCategoryOf[index] = category;
+    } else {
+        mCategoryOf.remove(index);
+    }
+    emit categoryChanged(mUids.uid(index));
+}
+
+void CommonConceptGraphScene::rebuildCategories()
+{
+    mCategoryOf.clear();
+    for (int category = 0; category < NUM_CATEGORIES; ++category)
+        mCategoryMembers[category].clear();
+
+    // Derive the whole partition from the graph (once)
+    Hyperedges allConcepts(graph().concepts());
+    Hyperedges allInstances(graph().instancesOf(allConcepts));
+    Hyperedges allClasses(subtract(allConcepts, allInstances));
     Hyperedges allRelations(graph().relations());
     Hyperedges allFacts(graph().factsOf(allRelations));
     Hyperedges allRelClasses(subtract(subtract(allRelations, allFacts), graph().access(CommonConceptGraph::FactOfId).pointingFrom()));
-    for (const UniqueId& classUID : allRelClasses)
-        result.push_back(QString::fromStdString(classUID));
-    return result;
+    const Hyperedges* members[NUM_CATEGORIES] = { NULL, &allClasses, &allInstances, &allRelClasses, &allFacts };
+    for (int category = CLASS_CATEGORY; category < NUM_CATEGORIES; ++category)
+    {
+        for (const UniqueId& id : *members[category])
+        {
+            const UidIndex::Index index(mUids.intern(id));
+            mCategoryMembers[category].insert(index);
+            mCategoryOf[index] = (Category)category;
+        }
+    }
+    emit categoryChanged(UniqueId());
 }
 
 void CommonConceptGraphScene::visualize(const CommonConceptGraph& graph)
 {
-    // Merge & visualize
-    currentCommonConceptGraph.importFrom(graph);
+    // Merge & visualize everything (this can not be undone)
+    mpCommonConceptGraph->importFrom(graph);
+    undoStack()->clear();
+    invalidateClassification();
+    rebuildCategories();
+    resync();
 }
 
 void CommonConceptGraphScene::updateVisualization()
 {
     visualize();
-    currentGraph = this->graph();
 }
 
-void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
+void CommonConceptGraphScene::visualize()
 {
-    // TODO: If something is an instance and we want to hide it, make it invisible (also for classes)
+    // Keep the timer running, so the job resumes once visualisation gets enabled
+    if (!mpUpdateTimer->isActive())
+        mpUpdateTimer->start(SYNC_INTERVAL_MS);
+
     // Suppress visualisation if desired
     if (!isEnabled())
         return;
 
-    Hyperedges allConcepts(this->graph().concepts());
-    if (!allConcepts.size())
+    if (mResyncPending)
+        startSweep();
+
+    // Sync as many concepts as fit into the budget: edited and visible ones first, then the rest
+    // NOTE: Each slice is a bulk update, so the viewers handle its new items at once
+    // NOTE: In deterministic mode the slices do not depend on the speed of the machine, so placement is reproducible
+    QElapsedTimer budget;
+    budget.start();
+    int synced = 0;
+    beginBulkUpdate();
+    while (mDeterministic ? (synced < SYNC_STEP_CONCEPTS) : (budget.elapsed() < SYNC_BUDGET_MS))
+    {
+        UniqueId conceptId;
+        if (!mSyncQueue.empty())
+        {
+            const UidIndex::Index index(mSyncQueue.front());
+            mSyncQueue.pop_front();
+            mSyncQueued.erase(index);
+            conceptId = mUids.uid(index);
+        } else if (mSweepIndex < mSweep.size()) {
+            // The sweep is a full load, so its items go into a summary of their own
+            if (!isFullLoad())
+            {
+                endBulkUpdate();
+                beginBulkUpdate();
+                mFullLoad = true;
+            }
+            conceptId = mSweep[mSweepIndex++];
+        } else {
+            // Done, wait for the next change
+            mSweep.clear();
+            mSweepIndex = 0;
+            mpUpdateTimer->stop();
+            break;
+        }
+        visualizeConcept(conceptId);
+        synced++;
+    }
+    endBulkUpdate();
+}
+
+void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
+{
+    // Edited concepts go first
+    const UidIndex::Index index(mUids.intern(updatedId));
+    if (mSyncQueued.insert(index).second)
+        mSyncQueue.push_front(index);
+    // ... followed by the ones depending on them
+    if (this->graph().exists(updatedId))
+        queueDependents(updatedId);
+    visualize();
+}
+
+void CommonConceptGraphScene::queueConcept(const UniqueId& conceptId)
+{
+    const UidIndex::Index index(mUids.intern(conceptId));
+    if (mSyncQueued.insert(index).second)
+        mSyncQueue.push_back(index);
+}
+
+void CommonConceptGraphScene::queueDependents(const UniqueId& conceptId)
+{
+    for (const UniqueId& id : this->graph().instancesOf(Hyperedges{conceptId}, "", CommonConceptGraph::TraversalDirection::BACKWARD))
+        queueConcept(id);
+    for (const UniqueId& id : this->graph().subclassesOf(Hyperedges{conceptId}, "", CommonConceptGraph::TraversalDirection::BACKWARD))
+        queueConcept(id);
+    for (const UniqueId& relId : this->graph().relationsTo(Hyperedges{conceptId}))
+    {
+        for (const UniqueId& id : this->graph().access(relId).pointingFrom())
+            queueConcept(id);
+    }
+}
+
+void CommonConceptGraphScene::startSweep()
+{
+    mResyncPending = false;
+    mJournal.clear();
+
+    // All concepts and the items of all concepts which are gone
+    mSweep = this->graph().concepts();
+    mSweepIndex = 0;
+    for (int index = 0; index < currentItems.size(); ++index)
+    {
+        if (currentItems.at(index) && !this->graph().exists(mUids.uid(index)))
+            mSweep.push_back(mUids.uid(index));
+    }
+
+    // Concepts in the viewport(s) come first
+    for (QGraphicsView* view : views())
+    {
+        QRectF visible(view->mapToScene(view->viewport()->rect()).boundingRect());
+        for (QGraphicsItem* item : items(visible))
+        {
+            HyperedgeItem* hitem = toHyperedgeItem(item);
+            if (!hitem)
+                continue;
+            const UidIndex::Index index(mUids.find(hitem->getHyperEdgeId()));
+            if (mSyncQueued.insert(index).second)
+                mSyncQueue.push_back(index);
+        }
+    }
+}
+
+QString CommonConceptGraphScene::superclassLabel(const Hyperedges& superclassIds)
+{
+    std::string result;
+    for (const UniqueId& superclassId : superclassIds)
+    {
+        result += (" " + this->graph().access(superclassId).label());
+    }
+    return QString::fromStdString(result);
+}
+
+int CommonConceptGraphScene::classifyFact(const UniqueId& factId)
+{
+    const UidIndex::Index index(mUids.intern(factId));
+    auto it(mFactKinds.constFind(index));
+    if (it != mFactKinds.constEnd())
+        return it.value();
+
+    // A fact is of all kinds of its super relation(s)
+    int kinds = NO_RELATION;
+    Hyperedges superRelations(this->graph().factsOf(factId, Hyperedges(), Hyperedges(), CommonConceptGraph::TraversalDirection::FORWARD));
+    for (const UniqueId& superId : superRelations)
+        kinds |= classifyRelation(superId);
+    mFactKinds.insert(index, kinds);
+    return kinds;
+}
+
+int CommonConceptGraphScene::classifyRelation(const UniqueId& relId)
+{
+    const UidIndex::Index index(mUids.intern(relId));
+    auto it(mRelationKinds.constFind(index));
+    if (it != mRelationKinds.constEnd())
+        return it.value();
+
+    // Extend the relation by its transitive closure
+    // Only then we can be sure that CommonConceptGraph relations are found
+    int kinds = NO_RELATION;
+    Hyperedges closure(unite(Hyperedges{relId}, this->graph().subrelationsOf(Hyperedges{relId}, "", CommonConceptGraph::TraversalDirection::FORWARD)));
+    for (const UniqueId& id : closure)
+    {
+        if (id == CommonConceptGraph::HasAId)
+            kinds |= HAS_A;
+        else if (id == CommonConceptGraph::PartOfId)
+            kinds |= PART_OF;
+        else if (id == CommonConceptGraph::IsAId)
+            kinds |= IS_A;
+        else if (id == CommonConceptGraph::InstanceOfId)
+            kinds |= INSTANCE_OF;
+        else if (id == CommonConceptGraph::ConnectsId)
+            kinds |= CONNECTS;
+    }
+    mRelationKinds.insert(index, kinds);
+    return kinds;
+}
+
+void CommonConceptGraphScene::invalidateClassification()
+{
+    mFactKinds.clear();
+    mRelationKinds.clear();
+}
+
+void CommonConceptGraphScene::refreshLabel(HyperedgeItem *item)
+{
+    CommonConceptGraphItem *citem(qgraphicsitem_cast<CommonConceptGraphItem*>(item));
+    if (!citem)
+    {
+        ConceptgraphScene::refreshLabel(item);
         return;
+    }
+    refreshConceptLabel(citem);
 
-    static UniqueId conceptId(allConcepts[0]);
+    // Instances and subclasses show the label as part of their superclass label
+    const UniqueId conceptId(citem->getHyperEdgeId());
+    Hyperedges dependents(unite(this->graph().instancesOf(Hyperedges{conceptId}, "", CommonConceptGraph::TraversalDirection::BACKWARD),
+                                this->graph().subclassesOf(Hyperedges{conceptId}, "", CommonConceptGraph::TraversalDirection::BACKWARD)));
+    for (const UniqueId& id : dependents)
+    {
+        CommonConceptGraphItem *ditem(qgraphicsitem_cast<CommonConceptGraphItem*>(itemOf(id)));
+        if (ditem)
+            refreshConceptLabel(ditem);
+    }
+}
 
-    // If we got a HINT on what to update, we do so
-    if (!updatedId.empty())
-        conceptId = updatedId;
+void CommonConceptGraphScene::refreshConceptLabel(CommonConceptGraphItem *item)
+{
+    const UniqueId conceptId(item->getHyperEdgeId());
+    Hyperedges superclassesOf(this->graph().instancesOf(Hyperedges{conceptId},"", CommonConceptGraph::TraversalDirection::FORWARD));
+    if (!superclassesOf.size())
+        superclassesOf = this->graph().subclassesOf(Hyperedges{conceptId},"",CommonConceptGraph::TraversalDirection::FORWARD);
+    item->setLabel(QString::fromStdString(this->graph().access(conceptId).label()), superclassLabel(superclassesOf));
+}
 
+void CommonConceptGraphScene::visualizeConcept(const UniqueId& conceptId)
+{
+    const UidIndex::Index index(mUids.intern(conceptId));
     // Find the current concept in graph
     if (!this->graph().exists(conceptId))
     {
         // Delete CommonConceptGraphItem if it (still) exists
-        if (currentItems.contains(conceptId))
+        CommonConceptGraphItem *toDelete(qgraphicsitem_cast<CommonConceptGraphItem*>(itemAtIndex(index)));
+        if (toDelete)
         {
-            CommonConceptGraphItem *toDelete(dynamic_cast<CommonConceptGraphItem*>(currentItems[conceptId]));
             // Check children: Put ownership back to scene
             QList< QGraphicsItem* > children = toDelete->childItems();
             for (QGraphicsItem* child : children)
@@ -199,13 +595,11 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
                 delete edge;
             }
             // Destruct the item
-            currentItems.remove(conceptId);
+            setItemAtIndex(index, NULL);
             removeItem(toDelete);
             delete toDelete;
         }
-
-        // In the following, start from the beginning
-        conceptId = allConcepts[0];
+        return;
     }
     
     // First, try to get superclasses of an instance
@@ -219,8 +613,8 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
     }
 
     // Check if the concept exists already
-    CommonConceptGraphItem *item(NULL);
-    if (!currentItems.contains(conceptId))
+    CommonConceptGraphItem *item(qgraphicsitem_cast<CommonConceptGraphItem*>(itemAtIndex(index)));
+    if (!item)
     {
         // Check if the concept is a class or an instance
         if (instance)
@@ -230,12 +624,15 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
             item = new CommonConceptGraphItem(conceptId, CommonConceptGraphItem::CLASS, this->graph().access(conceptId).label());
         }
         addItem(item);
-        currentItems[conceptId] = item;
-    } else {
-        // Delete the item if desired
-        item = dynamic_cast<CommonConceptGraphItem*>(currentItems[conceptId]);
+        setItemAtIndex(index, item);
     }
 
+    // Classes can become instances (and vice versa), so the item has to follow its classification
+    if (instance && mClassItems.remove(item))
+        mInstanceItems.insert(item);
+    if (!instance && mInstanceItems.remove(item))
+        mClassItems.insert(item);
+
     // Set visibility
     if (instance)
     {
@@ -247,59 +644,54 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
     }
 
     // Update label
-    std::string superclassLabel;
-    for (const UniqueId& superclassId : superclassesOf)
-    {
-        superclassLabel += (" " + this->graph().access(superclassId).label());
-    }
-    item->setLabel(QString::fromStdString(this->graph().access(conceptId).label()), QString::fromStdString(superclassLabel));
+    item->setLabel(QString::fromStdString(this->graph().access(conceptId).label()), superclassLabel(superclassesOf));
 
     // Update relations
+    // Group the relations from this concept by the concepts they point to, so we only visit each relation once
     Hyperedges relationsFrom(this->graph().relationsFrom(Hyperedges{conceptId}));
     CommonConceptGraphItem* srcItem(item);
-    auto myEdgeItems = srcItem->getEdgeItems();
-    Hyperedges otherIds(this->graph().isPointingTo(relationsFrom));
-    for (const UniqueId& otherId : otherIds)
+    QVector< QPair<UidIndex::Index, Hyperedges> > relationsByTarget;
+    QHash<UidIndex::Index, int> targetSlots;
+    for (const UniqueId& relId : relationsFrom)
+    {
+        for (const UniqueId& otherId : this->graph().access(relId).pointingTo())
+        {
+            const UidIndex::Index otherIndex(mUids.intern(otherId));
+            auto slot(targetSlots.constFind(otherIndex));
+            if (slot == targetSlots.constEnd())
+            {
+                targetSlots.insert(otherIndex, relationsByTarget.size());
+                relationsByTarget.append(qMakePair(otherIndex, Hyperedges{relId}));
+            } else {
+                relationsByTarget[slot.value()].second.push_back(relId);
+            }
+        }
+    }
+    for (const auto& target : relationsByTarget)
     {
         // Skip invalid items
-        if (!currentItems.contains(otherId))
-            continue;
-        CommonConceptGraphItem *destItem(dynamic_cast<CommonConceptGraphItem*>(currentItems[otherId]));
+        CommonConceptGraphItem *destItem(qgraphicsitem_cast<CommonConceptGraphItem*>(itemAtIndex(target.first)));
         if (!destItem)
             continue;
 
         // Check if there is an edgeitem which points to destItem
         // Also: if either src or target item are invisible set edge items to invisible as well
-        bool found = false;
-        for (auto line : myEdgeItems)
-        {
-            if (line->getTargetItem() == destItem)
-            {
-                found = true;
-                break;
-            }
-        }
+        const bool found(srcItem->findEdgeItem(destItem, EdgeItem::TO) != NULL);
 
-        Hyperedges relationsTo(this->graph().relationsTo(Hyperedges{otherId}));
-        // The intersection between relationsFrom and relationsTo are all relations between the two concepts
-        Hyperedges commonRelations(intersect(relationsFrom, relationsTo));
-        for (const UniqueId& relId : commonRelations)
+        // These are all relations between the two concepts
+        for (const UniqueId& relId : target.second)
         {
-            // Get super relation(s) of a fact
-            Hyperedges superRelations(this->graph().factsOf(relId, Hyperedges(), Hyperedges(), CommonConceptGraph::TraversalDirection::FORWARD));
-            if (!superRelations.size())
+            // Get the (cached) kinds of the super relation(s) of a fact
+            const int kinds(classifyFact(relId));
+            if (kinds == NO_RELATION)
             {
                 continue;
             }
 
-            // Extend superRelations by transitive closure
-            // Only then we can be sure that CommonConceptGraph relations are visible
-            superRelations = unite(superRelations, this->graph().subrelationsOf(superRelations, "", CommonConceptGraph::TraversalDirection::FORWARD));
-
             // Now we want to make the fact visible
             // We have to change style and/or color of the link depending on superclass
             // Or we interpret the edge (like parent-child relationship)
-            if (std::find(superRelations.begin(), superRelations.end(), CommonConceptGraph::HasAId) != superRelations.end())
+            if (kinds & HAS_A)
             {
                 // parent -- HAS-A --> child
                 // Check if this item is already part of the parent
@@ -315,7 +707,7 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
             if (found)
                 continue;
 
-            if (std::find(superRelations.begin(), superRelations.end(), CommonConceptGraph::PartOfId) != superRelations.end())
+            if (kinds & PART_OF)
             {
                 // part -- PART-OF --> whole
                 auto line = new CommonConceptGraphEdgeItem(srcItem, destItem, CommonConceptGraphEdgeItem::TO, CommonConceptGraphEdgeItem::DOTTED_STRAIGHT);
@@ -323,7 +715,7 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
                 continue;
             }
 
-            if (std::find(superRelations.begin(), superRelations.end(), CommonConceptGraph::IsAId) != superRelations.end())
+            if (kinds & IS_A)
             {
                 // subclass -- IS-A --> superclass
                 auto line = new CommonConceptGraphEdgeItem(srcItem, destItem, CommonConceptGraphEdgeItem::TO, CommonConceptGraphEdgeItem::SOLID_STRAIGHT);
@@ -331,7 +723,7 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
                 continue;
             }
 
-            if (std::find(superRelations.begin(), superRelations.end(), CommonConceptGraph::InstanceOfId) != superRelations.end())
+            if (kinds & INSTANCE_OF)
             {
                 // individual -- INSTANCE-OF --> superclass
                 auto line = new CommonConceptGraphEdgeItem(srcItem, destItem, CommonConceptGraphEdgeItem::TO, CommonConceptGraphEdgeItem::DASHED_STRAIGHT);
@@ -339,7 +731,7 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
                 continue;
             }
 
-            if (std::find(superRelations.begin(), superRelations.end(), CommonConceptGraph::ConnectsId) != superRelations.end())
+            if (kinds & CONNECTS)
             {
                 // interface -- CONNECTS --> interface
                 auto line = new CommonConceptGraphEdgeItem(srcItem, destItem, CommonConceptGraphEdgeItem::TO, CommonConceptGraphEdgeItem::SOLID_CURVED);
@@ -350,43 +742,52 @@ void CommonConceptGraphScene::visualize(const UniqueId& updatedId)
     }
 
     // Make edges visible or invisible
-    myEdgeItems = srcItem->getEdgeItems();
-    for (auto line : myEdgeItems)
+    for (auto line : srcItem->getEdgeItems())
     {
         line->setVisible(srcItem->isVisible() && line->getTargetItem()->isVisible());
     }
-
-    // Last step: Determine next concept
-    Hyperedges::const_iterator it(std::find(allConcepts.begin(), allConcepts.end(), conceptId));
-    it++;
-    if (it != allConcepts.end())
-    {
-        conceptId = *it;
-    } else {
-        conceptId = allConcepts[0];
-    }
 }
 
 CommonConceptGraphEditor::CommonConceptGraphEditor(QWidget *parent)
 : ConceptgraphEditor(parent)
 {
+    mpCachedScene = NULL;
+    mpCommonConceptGraphScene = NULL;
 }
 
 CommonConceptGraphEditor::CommonConceptGraphEditor(CommonConceptGraphScene * scene, QWidget * parent)
 : ConceptgraphEditor(scene, parent)
 {
+    mpCachedScene = NULL;
+    mpCommonConceptGraphScene = NULL;
 }
 
 void CommonConceptGraphEditor::keyPressEvent(QKeyEvent * event)
 {
     QList<CommonConceptGraphItem *> selection = scene()->selectedCommonConceptGraphItems();
-    if (event->key() == Qt::Key_Delete)
+    if (event->matches(QKeySequence::Undo))
     {
+        scene()->undoStack()->undo();
+    }
+    else if (event->matches(QKeySequence::Redo))
+    {
+        scene()->undoStack()->redo();
+    }
+    else if ((event->key() == Qt::Key_Delete) && !selection.isEmpty())
+    {
+        // Deleting the selection can be undone at once
+        // NOTE: The edges are removed ordered by their ids, so the recorded history does not depend on the selection order
+        Hyperedges ids;
         for (CommonConceptGraphItem *item : selection)
+            ids.push_back(item->getHyperEdgeId());
+        std::sort(ids.begin(), ids.end());
+        scene()->undoStack()->beginMacro(tr("Delete"));
+        for (const UniqueId& id : ids)
         {
             // Delete edge from graph
-            scene()->removeEdge(item->getHyperEdgeId());
+            scene()->removeEdge(id);
         }
+        scene()->undoStack()->endMacro();
     }
     else if (event->key() == Qt::Key_Insert)
     {
@@ -420,7 +821,7 @@ void CommonConceptGraphEditor::keyPressEvent(QKeyEvent * event)
     else if (event->key() == Qt::Key_Pause)
     {
         // Toggle force based layout on or off
-        ForceBasedScene *fbscene = dynamic_cast<ForceBasedScene*>(scene());
+        ForceBasedScene *fbscene = qobject_cast<ForceBasedScene*>(scene());
         if (fbscene)
         {
             fbscene->setLayoutEnabled(!fbscene->isLayoutEnabled());
@@ -443,6 +844,7 @@ void CommonConceptGraphEditor::keyPressEvent(QKeyEvent * event)
             // Start label edit
             isEditLabelMode = true;
             currentLabel = "";
+            scene()->beginLabelSession();
         }
         // Update current label
         if (event->key() != Qt::Key_Backspace)
@@ -451,10 +853,12 @@ void CommonConceptGraphEditor::keyPressEvent(QKeyEvent * event)
         } else {
             currentLabel.chop(1);
         }
+        Hyperedges ids;
         for (CommonConceptGraphItem *item : selection)
         {
-            scene()->updateEdge(item->getHyperEdgeId(), currentLabel);
+            ids.push_back(item->getHyperEdgeId());
         }
+        scene()->updateEdges(ids, currentLabel);
         setDefaultLabel(currentLabel);
     }
 
@@ -471,7 +875,7 @@ void CommonConceptGraphEditor::mousePressEvent(QMouseEvent* event)
     else if (event->button() == Qt::RightButton)
     {
         // If pressed on a CommonConceptGraphItem we start drawing a line
-        auto edge = dynamic_cast<CommonConceptGraphItem*>(item);
+        auto edge = qgraphicsitem_cast<CommonConceptGraphItem*>(item);
         if (edge)
         {
             lineItem = new QGraphicsLineItem();
@@ -492,7 +896,7 @@ void CommonConceptGraphEditor::mouseReleaseEvent(QMouseEvent* event)
     if ((event->button() == Qt::RightButton) && isDrawLineMode)
     {
         // Check if there is a CommonConceptGraphItem at current pos
-        auto edge = dynamic_cast<CommonConceptGraphItem*>(item);
+        auto edge = qgraphicsitem_cast<CommonConceptGraphItem*>(item);
         if (edge)
         {
             // First question: RELATION DEF or FACT
@@ -553,18 +957,41 @@ CommonConceptGraphWidget::CommonConceptGraphWidget(QWidget *parent, bool doSetup
         mpNewUi->View->setLayout(layout);
 
         //mpNewUi->usageLabel->setText("LMB: Select  RMB: Associate  WHEEL: Zoom  DEL: Delete  INS: Insert  PAUSE: Toggle Layouting");
-        mpNewUi->usageLabel->setText("LMB: Select  WHEEL: Zoom  DEL: Delete  PAUSE: Toggle Layouting  F1: Hide/Show Classes  F2: Hide/Show Instances");
+        mpNewUi->usageLabel->setText("LMB: Select  WHEEL: Zoom  DEL: Delete  PAUSE: Toggle Layouting  F1: Hide/Show Classes  F2: Hide/Show Instances  CTRL+Z/Y: Undo/Redo");
+
+        // Setup list models
+        mpClassModel = new UidListModel(this);
+        mpInstanceModel = new UidListModel(this);
+        mpRelationModel = new UidListModel(this);
+        mpFactModel = new UidListModel(this);
+        mListUpdatePending = false;
+        mListRebuildPending = false;
+        mpNewUi->classListView->setModel(mpClassModel);
+        mpNewUi->instanceListView->setModel(mpInstanceModel);
+        mpNewUi->relationListView->setModel(mpRelationModel);
+        mpNewUi->factListView->setModel(mpFactModel);
 
         // Connect
         connect(mpCommonConceptScene, SIGNAL(itemAdded(QGraphicsItem*)), this, SLOT(onGraphChanged(QGraphicsItem*)));
+        connect(mpCommonConceptScene, SIGNAL(itemsAdded(const QList<QGraphicsItem*>&)), this, SLOT(onItemsAdded(const QList<QGraphicsItem*>&)));
+        connect(mpCommonConceptScene, SIGNAL(layoutUpdated(qreal,unsigned int)), this, SLOT(onLayoutUpdated(qreal,unsigned int)));
         connect(mpCommonConceptScene, SIGNAL(instanceAdded(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpCommonConceptScene, SIGNAL(classAdded(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpCommonConceptScene, SIGNAL(instanceRemoved(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpCommonConceptScene, SIGNAL(classRemoved(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpCommonConceptScene, SIGNAL(relationAdded(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpCommonConceptScene, SIGNAL(relationRemoved(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
+        connect(mpCommonConceptScene, SIGNAL(categoryChanged(const UniqueId)), this, SLOT(onCategoryChanged(const UniqueId)));
+        // The scene has been categorized before we got connected
+        onCategoryChanged(UniqueId());
     } else {
         mpNewUi = NULL;
+        mpClassModel = NULL;
+        mpInstanceModel = NULL;
+        mpRelationModel = NULL;
+        mpFactModel = NULL;
+        mListUpdatePending = false;
+        mListRebuildPending = false;
     }
 }
 
@@ -574,6 +1001,11 @@ CommonConceptGraphWidget::~CommonConceptGraphWidget()
         delete mpNewUi;
 }
 
+QLabel* CommonConceptGraphWidget::statsLabel()
+{
+    return mpNewUi->statsLabel;
+}
+
 void CommonConceptGraphWidget::showEvent(QShowEvent *event)
 {
     // About to be shown
@@ -597,8 +1029,12 @@ void CommonConceptGraphWidget::loadFromYAML(const QString& yamlString)
 
 void CommonConceptGraphWidget::onGraphChanged(QGraphicsItem* item)
 {
-    HyperedgeItem *hitem(dynamic_cast< HyperedgeItem *>(item));
-    if (!hitem)
+    // Children (e.g. of HAS-A relations) are placed by their parents
+    HyperedgeItem *hitem(toHyperedgeItem(item));
+    if (!hitem || hitem->parentItem())
+        return;
+    // Known items go to their stored positions
+    if (restorePosition(hitem))
         return;
     // Get current scene pos of view
     QPointF centerOfView(mpCommonConceptEditor->mapToScene(mpCommonConceptEditor->viewport()->rect().center()));
@@ -608,27 +1044,54 @@ void CommonConceptGraphWidget::onGraphChanged(QGraphicsItem* item)
 
 void CommonConceptGraphWidget::onGraphChanged(const UniqueId id)
 {
-    // TODO: Use UID to update only PARTS of the GUI!
-    Hyperedges allConcepts(mpCommonConceptScene->graph().concepts());
-    Hyperedges allInstances(mpCommonConceptScene->graph().instancesOf(allConcepts));
-    Hyperedges allClasses(subtract(allConcepts, allInstances));
-    Hyperedges allRelations(mpCommonConceptScene->graph().relations());
-    Hyperedges allFacts(mpCommonConceptScene->graph().factsOf(allRelations));
-    Hyperedges allRelClasses(subtract(subtract(allRelations, allFacts), mpCommonConceptScene->graph().access(CommonConceptGraph::FactOfId).pointingFrom()));
-    // Fill the lists
-    mpNewUi->classListWidget->clear();
-    for (const UniqueId& classId : allClasses) mpNewUi->classListWidget->addItem(QString::fromStdString(classId));
-    mpNewUi->instanceListWidget->clear();
-    for (const UniqueId& instanceId : allInstances) mpNewUi->instanceListWidget->addItem(QString::fromStdString(instanceId));
-    mpNewUi->relationListWidget->clear();
-    for (const UniqueId& relationId : allRelClasses) mpNewUi->relationListWidget->addItem(QString::fromStdString(relationId));
-    mpNewUi->factListWidget->clear();
-    for (const UniqueId& factId : allFacts) mpNewUi->factListWidget->addItem(QString::fromStdString(factId));
     // Gets triggered whenever a concept||relations has been added||removed
-    mpNewUi->statsLabel->setText(
-                            "CLASSES: " + QString::number(allClasses.size()) +
-                            "  INSTANCES: " + QString::number(allInstances.size()) +
-                            "  RELATION CLASSES: " + QString::number(allRelClasses.size()) +
-                            "  FACTS: " + QString::number(allFacts.size())
-                             );
+    // NOTE: Many changes in a row (e.g. while loading) cause only one update
+    if (mListUpdatePending)
+        return;
+    mListUpdatePending = true;
+    QTimer::singleShot(0, this, SLOT(updateLists()));
+}
+
+void CommonConceptGraphWidget::onCategoryChanged(const UniqueId id)
+{
+    if (id.empty())
+    {
+        // Everything changed (e.g. after an import)
+        mListRebuildPending = true;
+    } else {
+        // Only the list of the old and the new category change
+        UidListModel* models[CommonConceptGraphScene::NUM_CATEGORIES] = { NULL, mpClassModel, mpInstanceModel, mpRelationModel, mpFactModel };
+        const CommonConceptGraphScene::Category category(mpCommonConceptScene->categoryOf(id));
+        for (int other = CommonConceptGraphScene::CLASS_CATEGORY; other < CommonConceptGraphScene::NUM_CATEGORIES; ++other)
+        {
+            if (other == category)
+                models[other]->insert(id);
+            else
+                models[other]->remove(id);
+        }
+    }
+    onGraphChanged(id);
+}
+
+void CommonConceptGraphWidget::updateLists()
+{
+    mListUpdatePending = false;
+    if (mListRebuildPending)
+    {
+        // Only the differences reach the views
+        mListRebuildPending = false;
+        mpClassModel->assign(mpCommonConceptScene->categoryMembers(CommonConceptGraphScene::CLASS_CATEGORY));
+        mpInstanceModel->assign(mpCommonConceptScene->categoryMembers(CommonConceptGraphScene::INSTANCE_CATEGORY));
+        mpRelationModel->assign(mpCommonConceptScene->categoryMembers(CommonConceptGraphScene::RELATION_CLASS_CATEGORY));
+        mpFactModel->assign(mpCommonConceptScene->categoryMembers(CommonConceptGraphScene::FACT_CATEGORY));
+    }
+    mpClassModel->flush();
+    mpInstanceModel->flush();
+    mpRelationModel->flush();
+    mpFactModel->flush();
+    mGraphStats = "CLASSES: " + QString::number(mpCommonConceptScene->categorySize(CommonConceptGraphScene::CLASS_CATEGORY)) +
+                  "  INSTANCES: " + QString::number(mpCommonConceptScene->categorySize(CommonConceptGraphScene::INSTANCE_CATEGORY)) +
+                  "  RELATION CLASSES: " + QString::number(mpCommonConceptScene->categorySize(CommonConceptGraphScene::RELATION_CLASS_CATEGORY)) +
+                  "  FACTS: " + QString::number(mpCommonConceptScene->categorySize(CommonConceptGraphScene::FACT_CATEGORY));
+    updateStats();
 }
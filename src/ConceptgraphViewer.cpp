@@ -7,30 +7,40 @@
 #include <QTimer>
 #include <QtCore>
 #include <QInputDialog>
+#include <QUndoStack>
 
 #include "Hypergraph.hpp"
 #include "Conceptgraph.hpp"
 #include "HypergraphYAML.hpp"
 #include <sstream>
 #include <iostream>
+#include <algorithm>
 
 ConceptgraphScene::ConceptgraphScene(QObject * parent)
-: ForceBasedScene(parent)
+: ConceptgraphScene(NULL, parent)
 {
 }
 
+ConceptgraphScene::ConceptgraphScene(Conceptgraph* graph, QObject * parent)
+: ForceBasedScene(graph ? graph : new Conceptgraph(), parent)
+{
+    mOwnsConceptGraph = (graph == NULL);
+    mpConceptGraph = static_cast<Conceptgraph*>(mpGraph);
+}
+
 ConceptgraphScene::~ConceptgraphScene()
 {
+    if (mOwnsConceptGraph)
+        delete mpConceptGraph;
 }
 
 QList<ConceptgraphItem*> ConceptgraphScene::selectedConceptgraphItems()
 {
-    // get all selected hyperedge items
-    QList<QGraphicsItem *> selItems = selectedItems();
+    // get all selected items from the registry of the base scene (in the order they got selected)
     QList<ConceptgraphItem *> selHItems;
-    for (QGraphicsItem *item : selItems)
+    for (HyperedgeItem *item : selectedHyperedgeItems())
     {
-        ConceptgraphItem* hitem = dynamic_cast<ConceptgraphItem*>(item);
+        ConceptgraphItem* hitem = qgraphicsitem_cast<ConceptgraphItem*>(item);
         if (hitem)
             selHItems.append(hitem);
     }
@@ -41,8 +51,10 @@ void ConceptgraphScene::addItem(QGraphicsItem *item)
 {
     ForceBasedScene::addItem(item);
 
-    // Emit signals
-    ConceptgraphItem *edge = dynamic_cast<ConceptgraphItem*>(item);
+    // Emit signals (unless they are summarized by a bulk update)
+    if (isBulkUpdating())
+        return;
+    ConceptgraphItem *edge = qgraphicsitem_cast<ConceptgraphItem*>(item);
     if (edge)
     {
         if (edge->getType() == ConceptgraphItem::CONCEPT)
@@ -55,7 +67,7 @@ void ConceptgraphScene::addItem(QGraphicsItem *item)
 void ConceptgraphScene::removeItem(QGraphicsItem *item)
 {
     // Emit signals
-    ConceptgraphItem *edge = dynamic_cast<ConceptgraphItem*>(item);
+    ConceptgraphItem *edge = qgraphicsitem_cast<ConceptgraphItem*>(item);
     if (edge)
     {
         if (edge->getType() == ConceptgraphItem::CONCEPT)
@@ -69,39 +81,50 @@ void ConceptgraphScene::removeItem(QGraphicsItem *item)
 
 void ConceptgraphScene::addConcept(const UniqueId id, const QString& label)
 {
-    if (id.empty())
-        currentConceptGraph.concept(label.toStdString(), label.toStdString());
-    else
-        currentConceptGraph.concept(id, label.toStdString());
+    const UniqueId uid(id.empty() ? label.toStdString() : id);
+    beginEdit(Hyperedges{uid});
+    mpConceptGraph->concept(uid, label.toStdString());
+    endEdit(tr("Add concept %1").arg(label));
     visualize();
 }
 
 void ConceptgraphScene::addRelation(const UniqueId fromId, const UniqueId toId, const UniqueId id, const QString& label)
 {
     if (id.empty())
-        currentConceptGraph.relate(Hyperedges{fromId}, Hyperedges{toId}, label.toStdString());
-    else
-        currentConceptGraph.relate(id, Hyperedges{fromId}, Hyperedges{toId}, label.toStdString());
+    {
+        beginEdit(Hyperedges());
+        recordNew(mpConceptGraph->relate(Hyperedges{fromId}, Hyperedges{toId}, label.toStdString()));
+    } else {
+        beginEdit(Hyperedges{id});
+        mpConceptGraph->relate(id, Hyperedges{fromId}, Hyperedges{toId}, label.toStdString());
+    }
+    endEdit(tr("Add relation %1").arg(label));
     visualize();
 }
 
 void ConceptgraphScene::removeEdge(const UniqueId id)
 {
-    currentConceptGraph.destroy(id);
+    beginEdit(Hyperedges{id});
+    mpConceptGraph->destroy(id);
+    endEdit(tr("Remove %1").arg(QString::fromStdString(id)));
     visualize();
 }
 
 void ConceptgraphScene::updateEdge(const UniqueId id, const QString& label)
 {
-    currentConceptGraph.access(id).label(label.toStdString());
+    // A single relabeling is never merged with others
+    beginLabelSession();
+    recordLabels(Hyperedges{id}, label);
+    mpConceptGraph->access(id).label(label.toStdString());
     visualize();
 }
 
 void ConceptgraphScene::visualize(const Conceptgraph& graph)
 {
-    // Merge & visualize
-    currentConceptGraph.importFrom(graph);
-    visualize();
+    // Merge & visualize (this can not be undone)
+    mpConceptGraph->importFrom(graph);
+    undoStack()->clear();
+    resync();
 }
 
 void ConceptgraphScene::visualize()
@@ -110,16 +133,21 @@ void ConceptgraphScene::visualize()
     if (!isEnabled())
         return;
 
-    // Make a snapshot of the current graph
-    Conceptgraph snapshot(this->graph());
-    currentGraph = snapshot;
+    // This is always a full resync, so the journal of the base scene is not needed
+    mJournal.clear();
+    beginBulkUpdate();
+    mFullLoad = mResyncPending;
+    mResyncPending = false;
 
     // Now get all edges of the graph
-    auto allConcepts(snapshot.concepts());
-    auto allRelations(snapshot.relations());
+    Conceptgraph& current(this->graph());
+    auto allConcepts(current.concepts());
+    auto allRelations(current.relations());
 
     // Then we go through all edges and check if we already have an ConceptgraphItem or not
-    QMap<UniqueId,ConceptgraphItem*> validItems;
+    // NOTE: validItems is indexed by the interned ids of the edges (NULL if not valid)
+    QVector<ConceptgraphItem*> validItems;
+    QVector<UidIndex::Index> validIndices;
     for (auto relId : allRelations)
     {
         // Skip basic models
@@ -128,62 +156,55 @@ void ConceptgraphScene::visualize()
         if (relId == Conceptgraph::IsRelationId)
             continue;
         // Create or get item
-        ConceptgraphItem *item;
-        if (!currentItems.contains(relId))
+        const UidIndex::Index index(mUids.intern(relId));
+        ConceptgraphItem *item = qgraphicsitem_cast<ConceptgraphItem*>(itemAtIndex(index));
+        if (!item)
         {
             item = new ConceptgraphItem(relId, ConceptgraphItem::RELATION);
             addItem(item);
-            currentItems[relId] = item;
-        } else {
-            item = dynamic_cast<ConceptgraphItem*>(currentItems[relId]);
+            setItemAtIndex(index, item);
         }
-        validItems[relId] = item;
+        if (index >= (UidIndex::Index)validItems.size())
+            validItems.resize(mUids.size());
+        validItems[index] = item;
+        validIndices.append(index);
     }
     for (auto conceptId : allConcepts)
     {
         // Create or get item
-        ConceptgraphItem *item;
-        if (!currentItems.contains(conceptId))
+        const UidIndex::Index index(mUids.intern(conceptId));
+        ConceptgraphItem *item = qgraphicsitem_cast<ConceptgraphItem*>(itemAtIndex(index));
+        if (!item)
         {
             item = new ConceptgraphItem(conceptId, ConceptgraphItem::CONCEPT);
             addItem(item);
-            currentItems[conceptId] = item;
-        } else {
-            item = dynamic_cast<ConceptgraphItem*>(currentItems[conceptId]);
+            setItemAtIndex(index, item);
         }
-        validItems[conceptId] = item;
+        if (index >= (UidIndex::Index)validItems.size())
+            validItems.resize(mUids.size());
+        validItems[index] = item;
+        validIndices.append(index);
     }
 
     // Everything which is in validItem should be wired
-    QMap<UniqueId,ConceptgraphItem*>::const_iterator it;
-    for (it = validItems.begin(); it != validItems.end(); ++it)
+    for (const UidIndex::Index index : validIndices)
     {
-        auto edgeId = it.key();
-        auto srcItem = it.value();
-        auto edge = snapshot.access(edgeId);
+        auto srcItem = validItems.at(index);
+        auto edge = current.access(mUids.uid(index));
         // Make sure that item and edge share the same label
         srcItem->setLabel(QString::fromStdString(edge.label()));
         for (auto otherId : edge.pointingTo())
         {
-            if (!validItems.contains(otherId))
+            const UidIndex::Index otherIndex(mUids.find(otherId));
+            if (otherIndex >= (UidIndex::Index)validItems.size())
                 continue;
             // Create line if needed
-            auto destItem = validItems[otherId];
-            // Omit loops
-            if (srcItem == destItem)
+            auto destItem = validItems.at(otherIndex);
+            // Omit loops & invalid items
+            if (!destItem || (srcItem == destItem))
                 continue;
             // Check if there is an edgeitem of type TO which points to destItem
-            bool found = false;
-            auto myEdgeItems = srcItem->getEdgeItems();
-            for (auto line : myEdgeItems)
-            {
-                if (line->getTargetItem() == destItem)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
+            if (!srcItem->findEdgeItem(destItem, EdgeItem::TO))
             {
                 auto line = new EdgeItem(srcItem, destItem);
                 addItem(line);
@@ -191,27 +212,16 @@ void ConceptgraphScene::visualize()
         }
         for (auto otherId : edge.pointingFrom())
         {
-            if (!validItems.contains(otherId))
+            const UidIndex::Index otherIndex(mUids.find(otherId));
+            if (otherIndex >= (UidIndex::Index)validItems.size())
                 continue;
             // Create line if needed
-            auto destItem = validItems[otherId];
-            // Omit loops
-            if (srcItem == destItem)
+            auto destItem = validItems.at(otherIndex);
+            // Omit loops & invalid items
+            if (!destItem || (srcItem == destItem))
                 continue;
             // Check if there is an edgeitem of type FROM which points to destItem
-            bool found = false;
-            auto myEdgeItems = srcItem->getEdgeItems();
-            for (auto line : myEdgeItems)
-            {
-                if (line->getType() != EdgeItem::FROM)
-                    continue;
-                if (line->getTargetItem() == destItem)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
+            if (!srcItem->findEdgeItem(destItem, EdgeItem::FROM))
             {
                 auto line = new EdgeItem(srcItem, destItem, EdgeItem::FROM);
                 addItem(line);
@@ -220,57 +230,172 @@ void ConceptgraphScene::visualize()
     }
 
     // Everything which is in currentItems but not in validItems has to be removed
-    // First: remove edges
-    QMap<UniqueId,HyperedgeItem*> toBeChecked(currentItems); // NOTE: Since we modify currentItems, we should make a snapshot of the current state
-    QMap<UniqueId,HyperedgeItem*>::const_iterator it2;
-    for (it2 = toBeChecked.begin(); it2 != toBeChecked.end(); ++it2)
+    QVector<UidIndex::Index> toBeRemoved;
+    for (int index = 0; index < currentItems.size(); ++index)
     {
-        auto id = it2.key();
-        if (validItems.contains(id))
+        if (!currentItems.at(index))
+            continue;
+        if ((index < validItems.size()) && validItems.at(index))
             continue;
-        auto item = it2.value();
-        auto edgeSet = item->getEdgeItems();
+        toBeRemoved.append(index);
+    }
+    // First: remove edges
+    for (const UidIndex::Index index : toBeRemoved)
+    {
+        auto edgeSet = currentItems.at(index)->getEdgeItems();
         for (auto edge : edgeSet)
         {
             edge->deregister();
             delete edge;
         }
     }
-
-    // Everything which is in currentItems but not in validItems has to be removed
     // Second: remove items
-    for (it2 = toBeChecked.begin(); it2 != toBeChecked.end(); ++it2)
+    for (const UidIndex::Index index : toBeRemoved)
     {
-        auto id = it2.key();
-        if (validItems.contains(id))
-            continue;
-        auto item = it2.value();
-        currentItems.remove(id);
+        auto item = currentItems.at(index);
+        setItemAtIndex(index, NULL);
         removeItem(item);
         delete item;
     }
+    endBulkUpdate();
+}
+
+void ConceptgraphScene::refreshEdges(const Hyperedges& ids)
+{
+    // Suppress visualisation if desired (the next visualize() catches up)
+    if (!isEnabled())
+        return;
+
+    // Undo/redo only change a few edges, so there is no need for a full resync
+    beginBulkUpdate();
+    // First: create or remove the items of the edges
+    std::set<UidIndex::Index> indices;
+    QVector<ConceptgraphItem*> items;
+    for (const UniqueId& id : ids)
+    {
+        if (!indices.insert(mUids.intern(id)).second)
+            continue;
+        ConceptgraphItem *item = syncItem(id);
+        if (item)
+            items.append(item);
+    }
+    // Second: update labels and rewire the lines starting at the items
+    for (ConceptgraphItem *srcItem : items)
+    {
+        const QSet<EdgeItem*> lines(srcItem->getEdgeItems());
+        for (auto line : lines)
+        {
+            if (line->getSourceItem() != srcItem)
+                continue;
+            line->deregister();
+            delete line;
+        }
+        auto edge = graph().access(srcItem->getHyperEdgeId());
+        srcItem->setLabel(QString::fromStdString(edge.label()));
+        for (auto otherId : edge.pointingTo())
+        {
+            ConceptgraphItem *destItem = qgraphicsitem_cast<ConceptgraphItem*>(itemOf(otherId));
+            if (!destItem || (srcItem == destItem))
+                continue;
+            auto line = new EdgeItem(srcItem, destItem);
+            addItem(line);
+        }
+        for (auto otherId : edge.pointingFrom())
+        {
+            ConceptgraphItem *destItem = qgraphicsitem_cast<ConceptgraphItem*>(itemOf(otherId));
+            if (!destItem || (srcItem == destItem))
+                continue;
+            auto line = new EdgeItem(srcItem, destItem, EdgeItem::FROM);
+            addItem(line);
+        }
+    }
+    endBulkUpdate();
+}
+
+ConceptgraphItem* ConceptgraphScene::syncItem(const UniqueId& id)
+{
+    const UidIndex::Index index(mUids.intern(id));
+    ConceptgraphItem *item = qgraphicsitem_cast<ConceptgraphItem*>(itemAtIndex(index));
+
+    // Concepts and relations are pointed to by the basic models (which are not shown)
+    bool isConcept = false;
+    bool isRelation = false;
+    if (graph().exists(id) && (id != Conceptgraph::IsConceptId) && (id != Conceptgraph::IsRelationId))
+    {
+        for (const UniqueId& otherId : graph().isPointingTo(Hyperedges{id}))
+        {
+            if (otherId == Conceptgraph::IsConceptId)
+                isConcept = true;
+            else if (otherId == Conceptgraph::IsRelationId)
+                isRelation = true;
+        }
+    }
+
+    if (!isConcept && !isRelation)
+    {
+        if (item)
+        {
+            auto edgeSet = item->getEdgeItems();
+            for (auto edge : edgeSet)
+            {
+                edge->deregister();
+                delete edge;
+            }
+            setItemAtIndex(index, NULL);
+            removeItem(item);
+            delete item;
+        }
+        return NULL;
+    }
+    if (!item)
+    {
+        item = new ConceptgraphItem(id, isConcept ? ConceptgraphItem::CONCEPT : ConceptgraphItem::RELATION);
+        addItem(item);
+        setItemAtIndex(index, item);
+    }
+    return item;
 }
 
 ConceptgraphEditor::ConceptgraphEditor(QWidget *parent)
 : HypergraphEdit(parent)
 {
+    mpCachedScene = NULL;
+    mpConceptgraphScene = NULL;
 }
 
 ConceptgraphEditor::ConceptgraphEditor(ConceptgraphScene * scene, QWidget * parent)
 : HypergraphEdit(scene, parent)
 {
+    mpCachedScene = NULL;
+    mpConceptgraphScene = NULL;
 }
 
 void ConceptgraphEditor::keyPressEvent(QKeyEvent * event)
 {
     QList<ConceptgraphItem *> selection = scene()->selectedConceptgraphItems();
-    if (event->key() == Qt::Key_Delete)
+    if (event->matches(QKeySequence::Undo))
+    {
+        scene()->undoStack()->undo();
+    }
+    else if (event->matches(QKeySequence::Redo))
+    {
+        scene()->undoStack()->redo();
+    }
+    else if ((event->key() == Qt::Key_Delete) && !selection.isEmpty())
     {
+        // Deleting the selection can be undone at once
+        // NOTE: The edges are removed ordered by their ids, so the recorded history does not depend on the selection order
+        Hyperedges ids;
         for (ConceptgraphItem *item : selection)
+            ids.push_back(item->getHyperEdgeId());
+        std::sort(ids.begin(), ids.end());
+        scene()->undoStack()->beginMacro(tr("Delete"));
+        for (const UniqueId& id : ids)
         {
             // Delete edge from graph
-            scene()->removeEdge(item->getHyperEdgeId());
+            scene()->removeEdge(id);
         }
+        scene()->undoStack()->endMacro();
     }
     else if (event->key() == Qt::Key_Insert)
     {
@@ -285,7 +410,7 @@ void ConceptgraphEditor::keyPressEvent(QKeyEvent * event)
     else if (event->key() == Qt::Key_Pause)
     {
         // Toggle force based layout on or off
-        ForceBasedScene *fbscene = dynamic_cast<ForceBasedScene*>(scene());
+        ForceBasedScene *fbscene = qobject_cast<ForceBasedScene*>(scene());
         if (fbscene)
         {
             fbscene->setLayoutEnabled(!fbscene->isLayoutEnabled());
@@ -298,6 +423,7 @@ void ConceptgraphEditor::keyPressEvent(QKeyEvent * event)
             // Start label edit
             isEditLabelMode = true;
             currentLabel = "";
+            scene()->beginLabelSession();
         }
         // Update current label
         if (event->key() != Qt::Key_Backspace)
@@ -306,10 +432,12 @@ void ConceptgraphEditor::keyPressEvent(QKeyEvent * event)
         } else {
             currentLabel.chop(1);
         }
+        Hyperedges ids;
         for (ConceptgraphItem *item : selection)
         {
-            scene()->updateEdge(item->getHyperEdgeId(), currentLabel);
+            ids.push_back(item->getHyperEdgeId());
         }
+        scene()->updateEdges(ids, currentLabel);
         setDefaultLabel(currentLabel);
     }
 
@@ -326,7 +454,7 @@ void ConceptgraphEditor::mousePressEvent(QMouseEvent* event)
     else if (event->button() == Qt::RightButton)
     {
         // If pressed on a ConceptgraphItem we start drawing a line
-        auto edge = dynamic_cast<ConceptgraphItem*>(item);
+        auto edge = qgraphicsitem_cast<ConceptgraphItem*>(item);
         if (edge)
         {
             lineItem = new QGraphicsLineItem();
@@ -347,7 +475,7 @@ void ConceptgraphEditor::mouseReleaseEvent(QMouseEvent* event)
     if ((event->button() == Qt::RightButton) && isDrawLineMode)
     {
         // Check if there is a ConceptgraphItem at current pos
-        auto edge = dynamic_cast<ConceptgraphItem*>(item);
+        auto edge = qgraphicsitem_cast<ConceptgraphItem*>(item);
         if (edge)
         {
             // Ask for URI
@@ -391,6 +519,8 @@ ConceptgraphWidget::ConceptgraphWidget(QWidget *parent, bool doSetup)
 
         // Connect
         connect(mpConceptScene, SIGNAL(itemAdded(QGraphicsItem*)), this, SLOT(onGraphChanged(QGraphicsItem*)));
+        connect(mpConceptScene, SIGNAL(itemsAdded(const QList<QGraphicsItem*>&)), this, SLOT(onItemsAdded(const QList<QGraphicsItem*>&)));
+        connect(mpConceptScene, SIGNAL(layoutUpdated(qreal,unsigned int)), this, SLOT(onLayoutUpdated(qreal,unsigned int)));
         connect(mpConceptScene, SIGNAL(conceptAdded(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpConceptScene, SIGNAL(conceptRemoved(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
         connect(mpConceptScene, SIGNAL(relationAdded(const UniqueId)), this, SLOT(onGraphChanged(const UniqueId)));
@@ -426,8 +556,12 @@ void ConceptgraphWidget::loadFromYAML(const QString& yamlString)
 
 void ConceptgraphWidget::onGraphChanged(QGraphicsItem* item)
 {
-    HyperedgeItem *hitem(dynamic_cast< HyperedgeItem *>(item));
-    if (!hitem)
+    // Children (e.g. of HAS-A relations) are placed by their parents
+    HyperedgeItem *hitem(toHyperedgeItem(item));
+    if (!hitem || hitem->parentItem())
+        return;
+    // Known items go to their stored positions
+    if (restorePosition(hitem))
         return;
     // Get current scene pos of view
     QPointF centerOfView(mpConceptEditor->mapToScene(mpConceptEditor->viewport()->rect().center()));
@@ -438,8 +572,7 @@ void ConceptgraphWidget::onGraphChanged(QGraphicsItem* item)
 void ConceptgraphWidget::onGraphChanged(const UniqueId id)
 {
     // Gets triggered whenever a concept||relations has been added||removed
-    mpUi->statsLabel->setText(
-                            "CONCEPTS: " + QString::number(mpConceptScene->graph().concepts().size()) +
-                            "  RELATIONS: " + QString::number(mpConceptScene->graph().relations().size())
-                             );
+    mGraphStats = "CONCEPTS: " + QString::number(mpConceptScene->graph().concepts().size()) +
+                  "  RELATIONS: " + QString::number(mpConceptScene->graph().relations().size());
+    updateStats();
 }
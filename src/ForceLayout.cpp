@@ -0,0 +1,439 @@
+#include "ForceLayout.hpp"
+#include <QMutexLocker>
+#include <QtCore>
+#include <cmath>
+#include <numeric>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Accumulates the repulsion between body i and all bodies j > i (~ 1/d^2, skipped beyond the cutoff)
+// Every pair is evaluated once: the force is added to body i and its reaction is subtracted from body j.
+// The loop runs over contiguous x/y arrays and is vectorized with AVX or SSE2 if available.
+static void repulseRow(const qreal* x, const qreal* y, const int n, const int i,
+                       const qreal cutoff_sqr, const qreal charge,
+                       qreal* accX, qreal* accY)
+{
+    const qreal xi(x[i]);
+    const qreal yi(y[i]);
+    qreal sumX(0.);
+    qreal sumY(0.);
+    int j = i + 1;
+#if defined(__AVX__) || defined(__SSE2__)
+    static_assert(sizeof(qreal) == sizeof(double), "The vectorized layout kernel requires qreal to be double");
+#endif
+#if defined(__AVX__)
+    const __m256d vxi(_mm256_set1_pd(xi));
+    const __m256d vyi(_mm256_set1_pd(yi));
+    const __m256d vmin(_mm256_set1_pd(1e-9));
+    const __m256d vcutoff(_mm256_set1_pd(cutoff_sqr));
+    const __m256d vcharge(_mm256_set1_pd(charge));
+    __m256d vsumX(_mm256_setzero_pd());
+    __m256d vsumY(_mm256_setzero_pd());
+    for (; j + 4 <= n; j += 4)
+    {
+        const __m256d dx(_mm256_sub_pd(vxi, _mm256_loadu_pd(x + j))); // points towards i
+        const __m256d dy(_mm256_sub_pd(vyi, _mm256_loadu_pd(y + j)));
+        const __m256d d2(_mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)));
+        // Mask out coincident bodies and bodies beyond the cutoff
+        const __m256d mask(_mm256_and_pd(_mm256_cmp_pd(d2, vmin, _CMP_GT_OQ), _mm256_cmp_pd(d2, vcutoff, _CMP_LT_OQ)));
+        const __m256d f(_mm256_and_pd(mask, _mm256_div_pd(vcharge, _mm256_mul_pd(d2, _mm256_sqrt_pd(d2)))));
+        const __m256d fx(_mm256_mul_pd(f, dx));
+        const __m256d fy(_mm256_mul_pd(f, dy));
+        vsumX = _mm256_add_pd(vsumX, fx);
+        vsumY = _mm256_add_pd(vsumY, fy);
+        // Reaction onto the bodies j..j+3
+        _mm256_storeu_pd(accX + j, _mm256_sub_pd(_mm256_loadu_pd(accX + j), fx));
+        _mm256_storeu_pd(accY + j, _mm256_sub_pd(_mm256_loadu_pd(accY + j), fy));
+    }
+    double lanesX[4], lanesY[4];
+    _mm256_storeu_pd(lanesX, vsumX);
+    _mm256_storeu_pd(lanesY, vsumY);
+    sumX += (lanesX[0] + lanesX[1]) + (lanesX[2] + lanesX[3]);
+    sumY += (lanesY[0] + lanesY[1]) + (lanesY[2] + lanesY[3]);
+#elif defined(__SSE2__)
+    const __m128d vxi(_mm_set1_pd(xi));
+    const __m128d vyi(_mm_set1_pd(yi));
+    const __m128d vmin(_mm_set1_pd(1e-9));
+    const __m128d vcutoff(_mm_set1_pd(cutoff_sqr));
+    const __m128d vcharge(_mm_set1_pd(charge));
+    __m128d vsumX(_mm_setzero_pd());
+    __m128d vsumY(_mm_setzero_pd());
+    for (; j + 2 <= n; j += 2)
+    {
+        const __m128d dx(_mm_sub_pd(vxi, _mm_loadu_pd(x + j))); // points towards i
+        const __m128d dy(_mm_sub_pd(vyi, _mm_loadu_pd(y + j)));
+        const __m128d d2(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)));
+        // Mask out coincident bodies and bodies beyond the cutoff
+        const __m128d mask(_mm_and_pd(_mm_cmpgt_pd(d2, vmin), _mm_cmplt_pd(d2, vcutoff)));
+        const __m128d f(_mm_and_pd(mask, _mm_div_pd(vcharge, _mm_mul_pd(d2, _mm_sqrt_pd(d2)))));
+        const __m128d fx(_mm_mul_pd(f, dx));
+        const __m128d fy(_mm_mul_pd(f, dy));
+        vsumX = _mm_add_pd(vsumX, fx);
+        vsumY = _mm_add_pd(vsumY, fy);
+        // Reaction onto the bodies j and j+1
+        _mm_storeu_pd(accX + j, _mm_sub_pd(_mm_loadu_pd(accX + j), fx));
+        _mm_storeu_pd(accY + j, _mm_sub_pd(_mm_loadu_pd(accY + j), fy));
+    }
+    double lanesX[2], lanesY[2];
+    _mm_storeu_pd(lanesX, vsumX);
+    _mm_storeu_pd(lanesY, vsumY);
+    sumX += lanesX[0] + lanesX[1];
+    sumY += lanesY[0] + lanesY[1];
+#endif
+    // Remainder (or everything if no SIMD is available)
+    for (; j < n; ++j)
+    {
+        const qreal dx(xi - x[j]);
+        const qreal dy(yi - y[j]);
+        const qreal length_sqr(dx * dx + dy * dy);
+        if ((length_sqr > 1e-9) && (length_sqr < cutoff_sqr))
+        {
+            const qreal f(charge / (length_sqr * qSqrt(length_sqr)));
+            sumX += f * dx;
+            sumY += f * dy;
+            accX[j] -= f * dx;
+            accY[j] -= f * dy;
+        }
+    }
+    accX[i] += sumX;
+    accY[i] += sumY;
+}
+
+// A QRunnable executing one share of the force computation
+class ForceLayoutTask : public QRunnable
+{
+    public:
+        ForceLayoutTask(ForceLayout *layout, const int task)
+        : mpLayout(layout), mTask(task)
+        {
+            setAutoDelete(false);
+        }
+
+        void run()
+        {
+            mpLayout->computeForces(mTask, mpLayout->mTasks.size());
+        }
+
+    protected:
+        ForceLayout *mpLayout;
+        int mTask;
+};
+
+ForceLayout::ForceLayout()
+{
+    mpSnapshot = NULL;
+    mNormalization = 0.;
+    setThreadCount(1);
+}
+
+ForceLayout::~ForceLayout()
+{
+    mPool.waitForDone();
+    for (ForceLayoutTask* task : mTasks)
+        delete task;
+}
+
+void ForceLayout::setThreadCount(const int count)
+{
+    const int tasks(qMax(1, count));
+    if (tasks == mTasks.size())
+        return;
+    for (ForceLayoutTask* task : mTasks)
+        delete task;
+    mTasks.resize(0);
+    for (int t = 0; t < tasks; ++t)
+        mTasks.append(new ForceLayoutTask(this, t));
+    mLocalDisplacementsX.resize(tasks);
+    mLocalDisplacementsY.resize(tasks);
+    mLocalRepulsionX.resize(tasks);
+    mLocalRepulsionY.resize(tasks);
+    // The calling thread always computes the first share itself
+    mPool.setMaxThreadCount(qMax(1, tasks - 1));
+}
+
+qreal ForceLayout::iterate(const LayoutSnapshot& snapshot, QVector<qreal>& resultX, QVector<qreal>& resultY)
+{
+    // Copy into the existing storage (no allocation if the size did not change)
+    const int M = snapshot.x.size();
+    resultX.resize(M);
+    resultY.resize(M);
+    qCopy(snapshot.x.constBegin(), snapshot.x.constEnd(), resultX.begin());
+    qCopy(snapshot.y.constBegin(), snapshot.y.constEnd(), resultY.begin());
+    setThreadCount(snapshot.threadCount);
+
+    // Gather free (and frozen) bodies into contiguous arrays
+    int N = 0;
+    for (int i = 0; i < M; ++i)
+    {
+        if (!snapshot.pinned.at(i))
+            N++;
+    }
+    mFreeBodies.resize(N);
+    mFreeX.resize(N);
+    mFreeY.resize(N);
+    mFreeMass.resize(snapshot.mass.isEmpty() ? 0 : N);
+    for (int i = 0, j = 0; i < M; ++i)
+    {
+        if (snapshot.pinned.at(i))
+            continue;
+        mFreeBodies[j] = i;
+        mFreeX[j] = snapshot.x.at(i);
+        mFreeY[j] = snapshot.y.at(i);
+        if (!mFreeMass.isEmpty())
+            mFreeMass[j] = snapshot.mass.at(i);
+        j++;
+    }
+
+    // Repulsion is normalized by the number (or total mass) of the free bodies unless the snapshot knows better
+    mNormalization = N;
+    if (!mFreeMass.isEmpty())
+        mNormalization = std::accumulate(mFreeMass.constBegin(), mFreeMass.constEnd(), qreal(0.));
+    if (snapshot.bodyCount > 0)
+        mNormalization = snapshot.bodyCount;
+    if (!N)
+        return 0.;
+    mRepulsionX.resize(N);
+    mRepulsionY.resize(N);
+
+    // Approximate repulsion by a quadtree: O(N log N)
+    if (snapshot.repulsionMode == BARNES_HUT_REPULSION)
+        mQuadTree.build(mFreeX, mFreeY, mFreeMass);
+
+    // Compute forces in parallel
+    mpSnapshot = &snapshot;
+    for (int t = 1; t < mTasks.size(); ++t)
+        mPool.start(mTasks[t]);
+    mTasks[0]->run();
+    mPool.waitForDone();
+    mpSnapshot = NULL;
+
+    // Merge the local repulsions of the exact mode (always in the same order)
+    if (snapshot.repulsionMode != BARNES_HUT_REPULSION)
+    {
+        for (int i = 0; i < N; ++i)
+        {
+            qreal rx(0.);
+            qreal ry(0.);
+            for (int t = 0; t < mTasks.size(); ++t)
+            {
+                rx += mLocalRepulsionX.at(t).at(i);
+                ry += mLocalRepulsionY.at(t).at(i);
+            }
+            mRepulsionX[i] = rx / mNormalization; // ~ 1/d^2 * 1/N
+            mRepulsionY[i] = ry / mNormalization;
+        }
+    }
+
+    // Merge the local spring displacements (always in the same order) & update positions
+    qreal* newX(resultX.data());
+    qreal* newY(resultY.data());
+    qreal energy(0.);
+    for (int i = 0; i < N; ++i)
+    {
+        const int body = mFreeBodies.at(i);
+        if (snapshot.frozen.at(body))
+            continue;
+        qreal dx(mRepulsionX.at(i));
+        qreal dy(mRepulsionY.at(i));
+        for (int t = 0; t < mTasks.size(); ++t)
+        {
+            dx += mLocalDisplacementsX.at(t).at(body);
+            dy += mLocalDisplacementsY.at(t).at(body);
+        }
+        // Check for bad values
+        if (std::isnan(dx) || std::isnan(dy))
+            continue;
+        if (std::isinf(dx) || std::isinf(dy))
+            continue;
+        qreal length(qSqrt(dx * dx + dy * dy));
+        if (snapshot.unitSteps)
+        {
+            // Move by the temperature along the force
+            energy += length;
+            if (length > 0.)
+            {
+                dx *= snapshot.temperature / length;
+                dy *= snapshot.temperature / length;
+            }
+        } else {
+            // Limit the displacement by the current temperature
+            if (length > snapshot.temperature)
+            {
+                dx *= snapshot.temperature / length;
+                dy *= snapshot.temperature / length;
+                length = snapshot.temperature;
+            }
+            energy += length;
+        }
+        newX[body] += dx; // x = x + disp
+        newY[body] += dy;
+    }
+    return energy;
+}
+
+void ForceLayout::computeForces(const int task, const int tasks)
+{
+    const LayoutSnapshot& snapshot(*mpSnapshot);
+    const qreal mEquilibriumDistance(snapshot.equilibriumDistance);
+    const qreal cutoff_sqr(100. * mEquilibriumDistance * mEquilibriumDistance); // 10 * equilibrium distance
+    const qreal charge(mEquilibriumDistance * mEquilibriumDistance * mEquilibriumDistance);
+    const int N = mFreeBodies.size();
+
+    // a) calculate all repelling forces
+    if (snapshot.repulsionMode == BARNES_HUT_REPULSION)
+    {
+        // NOTE: Every task owns a block of bodies, so the results can be written directly
+        const int firstBody = N * task / tasks;
+        const int lastBody = N * (task + 1) / tasks;
+        for (int i = firstBody; i < lastBody; ++i)
+        {
+            const QPointF repulsion(mQuadTree.repulsion(i, mEquilibriumDistance, snapshot.openingAngle));
+            mRepulsionX[i] = repulsion.x() / mNormalization; // ~ 1/d^2 * 1/N
+            mRepulsionY[i] = repulsion.y() / mNormalization;
+        }
+    } else {
+        // Every pair is evaluated once, so rows write to other bodies as well and go into the local buffer of the task
+        // NOTE: Row i has N-1-i pairs, so the rows are dealt out round robin to balance the tasks
+        QVector<qreal>& repulsionX(mLocalRepulsionX[task]);
+        QVector<qreal>& repulsionY(mLocalRepulsionY[task]);
+        repulsionX.fill(0., N);
+        repulsionY.fill(0., N);
+        const qreal* x(mFreeX.constData());
+        const qreal* y(mFreeY.constData());
+        for (int i = task; i < N; i += tasks)
+            repulseRow(x, y, N, i, cutoff_sqr, charge, repulsionX.data(), repulsionY.data());
+    }
+
+    // b) calc attraction forces between connected bodies into the local buffer
+    QVector<qreal>& localX(mLocalDisplacementsX[task]);
+    QVector<qreal>& localY(mLocalDisplacementsY[task]);
+    localX.fill(0., snapshot.x.size());
+    localY.fill(0., snapshot.y.size());
+    const qreal* x(snapshot.x.constData());
+    const qreal* y(snapshot.y.constData());
+    const int* sources(snapshot.edgeSources.constData());
+    const int* targets(snapshot.edgeTargets.constData());
+    qreal* dispX(localX.data());
+    qreal* dispY(localY.data());
+    const int E = snapshot.edgeSources.size();
+    const int first = E * task / tasks;
+    const int last = E * (task + 1) / tasks;
+    for (int e = first; e < last; ++e)
+    {
+        const int source = sources[e];
+        const int target = targets[e];
+        const qreal dx(x[source] - x[target]); // points towards source
+        const qreal dy(y[source] - y[target]);
+        const qreal length_sqr(dx * dx + dy * dy);
+
+        // Pull according to a spring
+        if (length_sqr > 1e-9)
+        {
+            const qreal f((1. - mEquilibriumDistance / qSqrt(length_sqr)) / N); // ~ d/N
+            dispX[source] -= f * dx;
+            dispY[source] -= f * dy;
+            dispX[target] += f * dx;
+            dispY[target] += f * dy;
+        }
+    }
+}
+
+ForceLayoutWorker::ForceLayoutWorker(QObject *parent)
+: QThread(parent)
+{
+    mHasSnapshot = false;
+    mBusy = false;
+    mHasResult = false;
+    mStop = false;
+    mFront = 0;
+    mEnergies[0] = 0.;
+    mEnergies[1] = 0.;
+}
+
+ForceLayoutWorker::~ForceLayoutWorker()
+{
+    stop();
+}
+
+bool ForceLayoutWorker::submit(const LayoutSnapshot& snapshot)
+{
+    QMutexLocker locker(&mMutex);
+    if (mBusy)
+        return false;
+    mSnapshot = snapshot;
+    mHasSnapshot = true;
+    // Results of older snapshots are not of interest anymore
+    mHasResult = false;
+    mBusy = true;
+    mCondition.wakeOne();
+    return true;
+}
+
+bool ForceLayoutWorker::isBusy()
+{
+    QMutexLocker locker(&mMutex);
+    return mBusy || mHasResult;
+}
+
+bool ForceLayoutWorker::fetch(QVector<qreal>& x, QVector<qreal>& y, qreal& energy)
+{
+    QMutexLocker locker(&mMutex);
+    if (!mHasResult)
+        return false;
+    // Hand out the front buffer and keep the old storage of the caller
+    qSwap(x, mBuffersX[mFront]);
+    qSwap(y, mBuffersY[mFront]);
+    energy = mEnergies[mFront];
+    mHasResult = false;
+    return true;
+}
+
+void ForceLayoutWorker::stop()
+{
+    {
+        QMutexLocker locker(&mMutex);
+        mStop = true;
+        mCondition.wakeOne();
+    }
+    wait();
+}
+
+void ForceLayoutWorker::run()
+{
+    LayoutSnapshot snapshot;
+    while (true)
+    {
+        int back;
+        {
+            // Wait for work
+            QMutexLocker locker(&mMutex);
+            while (!mHasSnapshot && !mStop)
+                mCondition.wait(&mMutex);
+            if (mStop)
+                return;
+            qSwap(snapshot, mSnapshot);
+            mHasSnapshot = false;
+            back = 1 - mFront;
+        }
+
+        // Compute into the back buffer (nobody else touches it)
+        if (snapshot.layoutMode == MULTILEVEL_LAYOUT)
+            mEnergies[back] = mMultilevel.compute(snapshot, mLayout, mBuffersX[back], mBuffersY[back]);
+        else
+            mEnergies[back] = mLayout.iterate(snapshot, mBuffersX[back], mBuffersY[back]);
+        // Release the shared arrays, so the submitter can update its snapshot in place
+        snapshot = LayoutSnapshot();
+
+        {
+            // Publish: swap buffers
+            QMutexLocker locker(&mMutex);
+            mFront = back;
+            mHasResult = true;
+            mBusy = false;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#include "GraphHistory.hpp"
+#include "HypergraphViewer.hpp"
+
+// Only label changes can be merged
+#define GRAPH_DELTA_LABEL_ID 1
+
+GraphDelta::GraphDelta(HypergraphScene *scene, const QString& text, const QVector<EdgeState>& before, const QVector<EdgeState>& after)
+: QUndoCommand(text),
+  mpScene(scene),
+  mBefore(before),
+  mAfter(after),
+  mSession(-1),
+  mApplied(true)
+{
+}
+
+GraphDelta::GraphDelta(HypergraphScene *scene, const QString& text, const QVector<LabelChange>& labels, const int session)
+: QUndoCommand(text),
+  mpScene(scene),
+  mLabels(labels),
+  mSession(session),
+  mApplied(true)
+{
+}
+
+GraphDelta::~GraphDelta()
+{
+}
+
+void GraphDelta::undo()
+{
+    mApplied = false;
+    mpScene->restoreEdges(mBefore);
+    for (const LabelChange& change : mLabels)
+        mpScene->restoreLabel(change.id, change.before);
+}
+
+void GraphDelta::redo()
+{
+    // QUndoStack::push() calls redo(), but the edit has been done already
+    if (mApplied)
+        return;
+    mApplied = true;
+    mpScene->restoreEdges(mAfter);
+    for (const LabelChange& change : mLabels)
+        mpScene->restoreLabel(change.id, change.after);
+}
+
+int GraphDelta::id() const
+{
+    return mLabels.isEmpty() ? -1 : GRAPH_DELTA_LABEL_ID;
+}
+
+bool GraphDelta::mergeWith(const QUndoCommand *other)
+{
+    // Merge relabelings of the very same edges within the same label edit session
+    const GraphDelta *delta(static_cast<const GraphDelta*>(other));
+    if (delta->mSession != mSession)
+        return false;
+    if (delta->mLabels.size() != mLabels.size())
+        return false;
+    for (int i = 0; i < mLabels.size(); ++i)
+    {
+        if (delta->mLabels.at(i).id != mLabels.at(i).id)
+            return false;
+    }
+    for (int i = 0; i < mLabels.size(); ++i)
+        mLabels[i].after = delta->mLabels.at(i).after;
+    return true;
+}
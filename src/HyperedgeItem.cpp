@@ -1,4 +1,5 @@
 #include "HyperedgeItem.hpp"
+#include "HypergraphViewer.hpp"
 #include <QWidget>
 #include <QPainter>
 #include <QPainterPath>
@@ -7,6 +8,14 @@
 #include <QtCore>
 #include <iostream>
 
+// Tells the scene (if it is a HypergraphScene) that its cached layout graph is outdated
+static void invalidateLayoutGraph(QGraphicsScene* scene)
+{
+    HypergraphScene* hscene = qobject_cast<HypergraphScene*>(scene);
+    if (hscene)
+        hscene->invalidateLayoutGraph();
+}
+
 HyperedgeItem::HyperedgeItem(const UniqueId& uid)
 : edgeId(uid)
 {
@@ -21,6 +30,12 @@ HyperedgeItem::HyperedgeItem(const UniqueId& uid)
 
 HyperedgeItem::~HyperedgeItem()
 {
+    HypergraphScene* hscene = qobject_cast<HypergraphScene*>(scene());
+    if (hscene)
+    {
+        hscene->itemDestroyed(this);
+        hscene->invalidateLayoutGraph();
+    }
 }
 
 QPointF HyperedgeItem::centerPos()
@@ -50,12 +65,21 @@ void HyperedgeItem::registerEdgeItem(EdgeItem *line)
     if (!mEdgeSet.contains(line))
     {
         mEdgeSet.insert(line);
+        if (line->getSourceItem() == this)
+            mOutgoing.insert(qMakePair(line->getTargetItem(), (int)line->getType()), line);
     }
 }
 
 void HyperedgeItem::deregisterEdgeItem(EdgeItem *line)
 {
-    mEdgeSet.remove(line);
+    if (!mEdgeSet.remove(line))
+        return;
+    if (line->getSourceItem() != this)
+        return;
+    // Only drop the index entry if it refers to this line (there might be parallel lines)
+    auto key(qMakePair(line->getTargetItem(), (int)line->getType()));
+    if (mOutgoing.value(key, NULL) == line)
+        mOutgoing.remove(key);
 }
 
 QVariant HyperedgeItem::itemChange(GraphicsItemChange change,
@@ -70,12 +94,27 @@ QVariant HyperedgeItem::itemChange(GraphicsItemChange change,
             // If we are part of a parent item we have to call its update func
             if (parentItem())
             {
-                HyperedgeItem* trueParent = dynamic_cast<HyperedgeItem*>(parentItem());
+                HyperedgeItem* trueParent = toHyperedgeItem(parentItem());
                 if (trueParent)
                     trueParent->updateEdgeItems();
             }
             break;
         }
+        case ItemSelectedHasChanged:
+        {
+            // Keep the selection registry of the scene up to date
+            HypergraphScene* hscene = qobject_cast<HypergraphScene*>(scene());
+            if (hscene)
+                hscene->itemSelected(this, value.toBool());
+            break;
+        }
+        case ItemVisibleHasChanged:
+        case ItemParentHasChanged:
+        {
+            // The set of items (or their parents) considered by the layout changed
+            invalidateLayoutGraph(scene());
+            break;
+        }
         case ItemChildAddedChange:
         {
             QGraphicsItem* child = qvariant_cast<QGraphicsItem*>(value);
@@ -119,10 +158,27 @@ EdgeItem::EdgeItem(HyperedgeItem *from, HyperedgeItem *to, const Type type)
 
 EdgeItem::~EdgeItem()
 {
+    HypergraphScene* hscene = qobject_cast<HypergraphScene*>(scene());
+    if (hscene)
+    {
+        hscene->itemDestroyed(this);
+        hscene->invalidateLayoutGraph();
+    }
+}
+
+QVariant EdgeItem::itemChange(GraphicsItemChange change, const QVariant& value)
+{
+    // Hidden edge items do not take part in the layout
+    if (change == ItemVisibleHasChanged)
+        invalidateLayoutGraph(scene());
+    return QGraphicsItem::itemChange(change, value);
 }
 
 void EdgeItem::deregister()
 {
+    HypergraphScene* hscene = qobject_cast<HypergraphScene*>(scene());
+    if (hscene)
+        hscene->itemDetached(this);
     mpSourceEdge->deregisterEdgeItem(this);
     mpTargetEdge->deregisterEdgeItem(this);
     mpSourceEdge = NULL;
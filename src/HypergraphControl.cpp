@@ -1,5 +1,6 @@
 #include "HypergraphControl.hpp"
 #include "ui_HypergraphControl.h"
+#include <QThread>
 
 HypergraphControl::HypergraphControl(QWidget *parent)
 {
@@ -10,6 +11,18 @@ HypergraphControl::HypergraphControl(QWidget *parent)
     mpUi->typeBox->addItem("Hypergraph",QVariant(HypergraphType::HYPERGRAPH));
     mpUi->typeBox->addItem("Concept Graph",QVariant(HypergraphType::CONCEPTGRAPH));
     mpUi->typeBox->addItem("Common Concept Graph",QVariant(HypergraphType::COMMONCONCEPTGRAPH));
+
+    // Fill the list of possible repulsion models
+    mpUi->repulsionBox->addItem("Exact",QVariant(RepulsionMode::EXACT_REPULSION));
+    mpUi->repulsionBox->addItem("Barnes-Hut",QVariant(RepulsionMode::BARNES_HUT_REPULSION));
+
+    // Fill the list of possible layout modes
+    mpUi->layoutModeBox->addItem("Single Level",QVariant(LayoutMode::SINGLE_LEVEL_LAYOUT));
+    mpUi->layoutModeBox->addItem("Multilevel",QVariant(LayoutMode::MULTILEVEL_LAYOUT));
+    mpUi->layoutModeBox->addItem("Local",QVariant(LayoutMode::LOCAL_LAYOUT));
+
+    // By default, use all cores for layouting
+    mpUi->threadBox->setValue(QThread::idealThreadCount());
 }
 
 HypergraphControl::~HypergraphControl()
@@ -17,6 +30,41 @@ HypergraphControl::~HypergraphControl()
     delete mpUi;
 }
 
+void HypergraphControl::setSeedValue(int seed)
+{
+    mpUi->seedBox->setValue(seed);
+}
+
+qreal HypergraphControl::equilibriumDistance() const
+{
+    return 1. * mpUi->equiBox->value();
+}
+
+RepulsionMode HypergraphControl::repulsionMode() const
+{
+    return static_cast<RepulsionMode>(mpUi->repulsionBox->itemData(mpUi->repulsionBox->currentIndex()).toUInt());
+}
+
+qreal HypergraphControl::openingAngle() const
+{
+    return mpUi->thetaBox->value();
+}
+
+int HypergraphControl::threadCount() const
+{
+    return mpUi->threadBox->value();
+}
+
+LayoutMode HypergraphControl::layoutMode() const
+{
+    return static_cast<LayoutMode>(mpUi->layoutModeBox->itemData(mpUi->layoutModeBox->currentIndex()).toUInt());
+}
+
+int HypergraphControl::localHops() const
+{
+    return mpUi->hopBox->value();
+}
+
 void HypergraphControl::on_loadButton_clicked()
 {
     emit loadHypergraph(static_cast<HypergraphType>(mpUi->typeBox->itemData(mpUi->typeBox->currentIndex()).toUInt()));
@@ -48,3 +96,37 @@ void HypergraphControl::on_equiBox_valueChanged(int value)
     mpUi->equiBox->setValue(value);
     emit setEquilibriumDistance(1. * value);
 }
+
+void HypergraphControl::on_repulsionBox_currentIndexChanged(int index)
+{
+    RepulsionMode mode(static_cast<RepulsionMode>(mpUi->repulsionBox->itemData(index).toUInt()));
+    mpUi->thetaBox->setEnabled(mode == RepulsionMode::BARNES_HUT_REPULSION);
+    emit setRepulsionMode(mode);
+}
+
+void HypergraphControl::on_thetaBox_valueChanged(double value)
+{
+    emit setOpeningAngle(value);
+}
+
+void HypergraphControl::on_threadBox_valueChanged(int value)
+{
+    emit setThreadCount(value);
+}
+
+void HypergraphControl::on_layoutModeBox_currentIndexChanged(int index)
+{
+    LayoutMode mode(static_cast<LayoutMode>(mpUi->layoutModeBox->itemData(index).toUInt()));
+    mpUi->hopBox->setEnabled(mode == LayoutMode::LOCAL_LAYOUT);
+    emit setLayoutMode(mode);
+}
+
+void HypergraphControl::on_hopBox_valueChanged(int value)
+{
+    emit setLocalHops(value);
+}
+
+void HypergraphControl::on_seedBox_valueChanged(int value)
+{
+    emit setSeed(value);
+}
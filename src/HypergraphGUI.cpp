@@ -11,6 +11,13 @@
 #include <QTextStream>
 #include "Hyperedge.hpp"
 
+// Node positions are stored next to the graph: foo.yml -> foo.layout.yml
+static QString layoutFileName(const QString& fileName)
+{
+    QFileInfo info(fileName);
+    return info.absolutePath() + "/" + info.completeBaseName() + ".layout.yml";
+}
+
 HypergraphGUI::HypergraphGUI(QWidget *parent)
     : QMainWindow(parent)
 {
@@ -29,6 +36,7 @@ HypergraphGUI::HypergraphGUI(QWidget *parent)
 
     lastOpenedFile = "";
     lastSavedFile = "";
+    mSeed = 0;
 
     // Connect control
     connect(mpControl, SIGNAL(clearHypergraph()), this, SLOT(clearHypergraphRequest()));
@@ -36,6 +44,12 @@ HypergraphGUI::HypergraphGUI(QWidget *parent)
     connect(mpControl, SIGNAL(loadHypergraph(HypergraphType)), this, SLOT(loadHypergraphRequest(HypergraphType)));
     connect(mpControl, SIGNAL(storeHypergraph()), this, SLOT(storeHypergraphRequest()));
     connect(mpControl, SIGNAL(setEquilibriumDistance(qreal)), this, SLOT(setEquilibriumDistanceRequest(qreal)));
+    connect(mpControl, SIGNAL(setRepulsionMode(RepulsionMode)), this, SLOT(setRepulsionModeRequest(RepulsionMode)));
+    connect(mpControl, SIGNAL(setOpeningAngle(qreal)), this, SLOT(setOpeningAngleRequest(qreal)));
+    connect(mpControl, SIGNAL(setThreadCount(int)), this, SLOT(setThreadCountRequest(int)));
+    connect(mpControl, SIGNAL(setLayoutMode(LayoutMode)), this, SLOT(setLayoutModeRequest(LayoutMode)));
+    connect(mpControl, SIGNAL(setLocalHops(int)), this, SLOT(setLocalHopsRequest(int)));
+    connect(mpControl, SIGNAL(setSeed(int)), this, SLOT(setSeedRequest(int)));
 }
 
 HypergraphGUI::~HypergraphGUI()
@@ -52,6 +66,74 @@ void HypergraphGUI::setEquilibriumDistanceRequest(qreal distance)
     }
 }
 
+void HypergraphGUI::setRepulsionModeRequest(RepulsionMode mode)
+{
+    HypergraphViewer* mpHypergraphViewer = dynamic_cast<HypergraphViewer*>(mpViewerTabWidget->currentWidget());
+    if (mpHypergraphViewer)
+    {
+        mpHypergraphViewer->setRepulsionMode(mode);
+    }
+}
+
+void HypergraphGUI::setOpeningAngleRequest(qreal theta)
+{
+    HypergraphViewer* mpHypergraphViewer = dynamic_cast<HypergraphViewer*>(mpViewerTabWidget->currentWidget());
+    if (mpHypergraphViewer)
+    {
+        mpHypergraphViewer->setOpeningAngle(theta);
+    }
+}
+
+void HypergraphGUI::setThreadCountRequest(int count)
+{
+    HypergraphViewer* mpHypergraphViewer = dynamic_cast<HypergraphViewer*>(mpViewerTabWidget->currentWidget());
+    if (mpHypergraphViewer)
+    {
+        mpHypergraphViewer->setThreadCount(count);
+    }
+}
+
+void HypergraphGUI::setLayoutModeRequest(LayoutMode mode)
+{
+    HypergraphViewer* mpHypergraphViewer = dynamic_cast<HypergraphViewer*>(mpViewerTabWidget->currentWidget());
+    if (mpHypergraphViewer)
+    {
+        mpHypergraphViewer->setLayoutMode(mode);
+    }
+}
+
+void HypergraphGUI::setLocalHopsRequest(int hops)
+{
+    HypergraphViewer* mpHypergraphViewer = dynamic_cast<HypergraphViewer*>(mpViewerTabWidget->currentWidget());
+    if (mpHypergraphViewer)
+    {
+        mpHypergraphViewer->setLocalHops(hops);
+    }
+}
+
+void HypergraphGUI::setSeedRequest(int seed)
+{
+    mSeed = qMax(0, seed);
+    mpControl->setSeedValue(mSeed);
+}
+
+void HypergraphGUI::reseed()
+{
+    if (mSeed > 0)
+        qsrand(mSeed);
+}
+
+void HypergraphGUI::applySettings(HypergraphViewer* viewer)
+{
+    viewer->setEquilibriumDistance(mpControl->equilibriumDistance());
+    viewer->setRepulsionMode(mpControl->repulsionMode());
+    viewer->setOpeningAngle(mpControl->openingAngle());
+    viewer->setThreadCount(mpControl->threadCount());
+    viewer->setLayoutMode(mpControl->layoutMode());
+    viewer->setLocalHops(mpControl->localHops());
+    viewer->setDeterministic(mSeed > 0);
+}
+
 void HypergraphGUI::clearHypergraphRequest()
 {
     // If there is a tab widget, destroy it
@@ -63,13 +145,16 @@ void HypergraphGUI::clearHypergraphRequest()
 
 void HypergraphGUI::newHypergraphRequest(HypergraphType type)
 {
+    reseed();
     switch (type)
     {
         case COMMONCONCEPTGRAPH:
             {
                 CommonConceptGraphWidget* commonConceptGraphWidget = new CommonConceptGraphWidget();
                 mpViewerTabWidget->addTab(commonConceptGraphWidget, "CommonConceptGraph");
+                applySettings(commonConceptGraphWidget);
                 connect(commonConceptGraphWidget, SIGNAL(YAMLStringReady(const QString&)), this, SLOT(onYAMLStringReady(const QString&)));
+                connect(commonConceptGraphWidget, SIGNAL(positionsYAMLReady(const QString&)), this, SLOT(onPositionsYAMLReady(const QString&)));
                 CommonConceptGraph empty;
                 commonConceptGraphWidget->loadFromGraph(empty);
             }
@@ -78,7 +163,9 @@ void HypergraphGUI::newHypergraphRequest(HypergraphType type)
             {
                 ConceptgraphWidget* conceptGraphWidget = new ConceptgraphWidget();
                 mpViewerTabWidget->addTab(conceptGraphWidget, "Conceptgraph");
+                applySettings(conceptGraphWidget);
                 connect(conceptGraphWidget, SIGNAL(YAMLStringReady(const QString&)), this, SLOT(onYAMLStringReady(const QString&)));
+                connect(conceptGraphWidget, SIGNAL(positionsYAMLReady(const QString&)), this, SLOT(onPositionsYAMLReady(const QString&)));
                 Conceptgraph empty;
                 conceptGraphWidget->loadFromGraph(empty);
             }
@@ -87,7 +174,9 @@ void HypergraphGUI::newHypergraphRequest(HypergraphType type)
             {
                 HypergraphViewer* hypergraphViewer = new HypergraphViewer();
                 mpViewerTabWidget->addTab(hypergraphViewer, "Hypergraph");
+                applySettings(hypergraphViewer);
                 connect(hypergraphViewer, SIGNAL(YAMLStringReady(const QString&)), this, SLOT(onYAMLStringReady(const QString&)));
+                connect(hypergraphViewer, SIGNAL(positionsYAMLReady(const QString&)), this, SLOT(onPositionsYAMLReady(const QString&)));
                 Conceptgraph empty;
                 hypergraphViewer->loadFromGraph(empty);
             }
@@ -120,13 +209,17 @@ void HypergraphGUI::loadHypergraphRequest(HypergraphType type)
             QString yamlString = fin.readAll();
             file.close();
             lastOpenedFile = fileName;
+            reseed();
             switch (type)
             {
                 case COMMONCONCEPTGRAPH:
                     {
                         CommonConceptGraphWidget* commonConceptGraphWidget = new CommonConceptGraphWidget();
                         mpViewerTabWidget->addTab(commonConceptGraphWidget, "CommonConceptGraph");
+                        applySettings(commonConceptGraphWidget);
                         connect(commonConceptGraphWidget, SIGNAL(YAMLStringReady(const QString&)), this, SLOT(onYAMLStringReady(const QString&)));
+                        connect(commonConceptGraphWidget, SIGNAL(positionsYAMLReady(const QString&)), this, SLOT(onPositionsYAMLReady(const QString&)));
+                        commonConceptGraphWidget->loadPositionsFromYAMLFile(layoutFileName(fileName));
                         commonConceptGraphWidget->loadFromYAML(yamlString);
                     }
                     break;
@@ -134,7 +227,10 @@ void HypergraphGUI::loadHypergraphRequest(HypergraphType type)
                     {
                         ConceptgraphWidget* conceptGraphWidget = new ConceptgraphWidget();
                         mpViewerTabWidget->addTab(conceptGraphWidget, "Conceptgraph");
+                        applySettings(conceptGraphWidget);
                         connect(conceptGraphWidget, SIGNAL(YAMLStringReady(const QString&)), this, SLOT(onYAMLStringReady(const QString&)));
+                        connect(conceptGraphWidget, SIGNAL(positionsYAMLReady(const QString&)), this, SLOT(onPositionsYAMLReady(const QString&)));
+                        conceptGraphWidget->loadPositionsFromYAMLFile(layoutFileName(fileName));
                         conceptGraphWidget->loadFromYAML(yamlString);
                     }
                     break;
@@ -142,7 +238,10 @@ void HypergraphGUI::loadHypergraphRequest(HypergraphType type)
                     {
                         HypergraphViewer* hypergraphViewer = new HypergraphViewer();
                         mpViewerTabWidget->addTab(hypergraphViewer, "Hypergraph");
+                        applySettings(hypergraphViewer);
                         connect(hypergraphViewer, SIGNAL(YAMLStringReady(const QString&)), this, SLOT(onYAMLStringReady(const QString&)));
+                        connect(hypergraphViewer, SIGNAL(positionsYAMLReady(const QString&)), this, SLOT(onPositionsYAMLReady(const QString&)));
+                        hypergraphViewer->loadPositionsFromYAMLFile(layoutFileName(fileName));
                         hypergraphViewer->loadFromYAML(yamlString);
                     }
                     break;
@@ -193,3 +292,19 @@ void HypergraphGUI::onYAMLStringReady(const QString& yamlString)
         }
     }
 }
+
+void HypergraphGUI::onPositionsYAMLReady(const QString& yamlString)
+{
+    if (!lastSavedFile.isEmpty())
+    {
+        QFile file(layoutFileName(lastSavedFile));
+        if (file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            QTextStream fout(&file);
+            fout << yamlString;
+            file.close();
+        } else {
+            // Opening failed
+        }
+    }
+}
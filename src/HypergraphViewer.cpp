@@ -1,53 +1,152 @@
 #include "HypergraphViewer.hpp"
 #include "ui_HypergraphViewer.h"
 #include "HyperedgeItem.hpp"
+#include "ForceLayout.hpp"
 
 #include <QGraphicsScene>
 #include <QWheelEvent>
 #include <QTimer>
 #include <QtCore>
 #include <QInputDialog>
+#include <QUndoStack>
 
 #include "Hyperedge.hpp"
 #include "Hypergraph.hpp"
 #include "HypergraphYAML.hpp"
 #include <sstream>
+#include <algorithm>
 #include <iostream>
 
+// The layout is considered settled if bodies move less than this (in pixels per iteration on average)
+#define LAYOUT_CONVERGENCE_THRESHOLD 0.1
+// Temperature factor applied per iteration (or its inverse if the layout makes steady progress)
+#define LAYOUT_COOLING_FACTOR 0.9
+// Temperature (relative to the equilibrium distance) of the refinement following a multilevel layout
+#define LAYOUT_REFINEMENT_TEMPERATURE 0.1
+// Items of relabeled edges are refreshed at most once per frame (in ms)
+#define LABEL_REFRESH_INTERVAL 40
+
 HypergraphScene::HypergraphScene(QObject * parent)
+: HypergraphScene(NULL, parent)
+{
+}
+
+HypergraphScene::HypergraphScene(Hypergraph* graph, QObject * parent)
 : QGraphicsScene(parent)
 {
+    mOwnsGraph = (graph == NULL);
+    mpGraph = mOwnsGraph ? new Hypergraph() : graph;
+    mResyncPending = false;
+    mBulkDepth = 0;
+    mFullLoad = false;
+    mpUndoStack = new QUndoStack(this);
+    mLabelSession = 0;
+    mpLabelTimer = new QTimer(this);
+    mpLabelTimer->setSingleShot(true);
+    mpLabelTimer->setInterval(LABEL_REFRESH_INTERVAL);
+    connect(mpLabelTimer, SIGNAL(timeout()), this, SLOT(refreshLabels()));
 }
 
 HypergraphScene::~HypergraphScene()
 {
+    if (mOwnsGraph)
+        delete mpGraph;
 }
 
 QList<HyperedgeItem*> HypergraphScene::selectedHyperedgeItems()
 {
-    // get all selected hyperedge items
-    QList<QGraphicsItem *> selItems = selectedItems();
-    QList<HyperedgeItem *> selHItems;
-    for (QGraphicsItem *item : selItems)
+    QList<HyperedgeItem*> result;
+    result.reserve(mSelectedItems.size());
+    for (HyperedgeItem *item : mSelectedItems)
+        result.append(item);
+    return result;
+}
+
+void HypergraphScene::itemSelected(HyperedgeItem *item, const bool selected)
+{
+    if (selected)
+    {
+        if (!mSelectedPositions.contains(item))
+            mSelectedPositions[item] = mSelectedItems.insert(mSelectedItems.end(), item);
+    } else {
+        auto it = mSelectedPositions.find(item);
+        if (it == mSelectedPositions.end())
+            return;
+        mSelectedItems.erase(it.value());
+        mSelectedPositions.erase(it);
+    }
+}
+
+void HypergraphScene::itemDestroyed(HyperedgeItem *item)
+{
+    // NOTE: The item is (partially) destructed already, so we only compare pointers here
+    mHyperedgeItems.remove(item);
+    itemSelected(item, false);
+    forgetBulkItem(item);
+}
+
+void HypergraphScene::itemDestroyed(EdgeItem *item)
+{
+    forgetBulkItem(item);
+}
+
+void HypergraphScene::beginBulkUpdate()
+{
+    mBulkDepth++;
+}
+
+void HypergraphScene::endBulkUpdate()
+{
+    if (!mBulkDepth || --mBulkDepth)
+        return;
+    if (!mBulkItems.isEmpty())
     {
-        HyperedgeItem* hitem = dynamic_cast<HyperedgeItem*>(item);
-        if (hitem)
-            selHItems.append(hitem);
+        QList<QGraphicsItem*> items(mBulkItems);
+        mBulkItems.clear();
+        mBulkItemSet.clear();
+        emit itemsAdded(items);
     }
-    return selHItems;
+    // The summary has been delivered, so a full load ends here
+    mFullLoad = false;
+}
+
+void HypergraphScene::forgetBulkItem(QGraphicsItem *item)
+{
+    if (mBulkItemSet.remove(item))
+        mBulkItems.removeOne(item);
 }
 
 void HypergraphScene::addItem(QGraphicsItem *item)
 {
     QGraphicsScene::addItem(item);
 
+    HyperedgeItem *edge = toHyperedgeItem(item);
+    EdgeItem *conn = toEdgeItem(item);
+    if (edge)
+    {
+        mHyperedgeItems.insert(edge);
+        if (edge->isSelected())
+            itemSelected(edge, true);
+    }
+    if (edge || conn)
+        invalidateLayoutGraph();
+
+    // Collect the item for the summary
+    if (isBulkUpdating())
+    {
+        if (!mBulkItemSet.contains(item))
+        {
+            mBulkItemSet.insert(item);
+            mBulkItems.append(item);
+        }
+        return;
+    }
+
     // Emit signals
-    HyperedgeItem *edge = dynamic_cast<HyperedgeItem*>(item);
     if (edge)
     {
         emit edgeAdded(edge->getHyperEdgeId());
     }
-    EdgeItem *conn = dynamic_cast<EdgeItem*>(item);
     if (conn)
     {
         emit edgesConnected(conn->getSourceItem()->getHyperEdgeId(), conn->getTargetItem()->getHyperEdgeId());
@@ -59,206 +158,597 @@ void HypergraphScene::addItem(QGraphicsItem *item)
 
 void HypergraphScene::removeItem(QGraphicsItem *item)
 {
+    forgetBulkItem(item);
+
     // Emit signals
-    HyperedgeItem *edge = dynamic_cast<HyperedgeItem*>(item);
+    HyperedgeItem *edge = toHyperedgeItem(item);
+    EdgeItem *conn = toEdgeItem(item);
     if (edge)
     {
+        mHyperedgeItems.remove(edge);
+        itemSelected(edge, false);
         emit edgeRemoved(edge->getHyperEdgeId());
     }
+    if (edge || conn)
+        invalidateLayoutGraph();
 
     QGraphicsScene::removeItem(item);
 }
 
 void HypergraphScene::addEdge(const UniqueId id, const QString& label)
 {
-    currentGraph.create(id, label.toStdString());
+    beginEdit(Hyperedges{id});
+    mpGraph->create(id, label.toStdString());
+    endEdit(tr("Add %1").arg(QString::fromStdString(id)));
+    touch(id);
     visualize();
 }
 
 void HypergraphScene::removeEdge(const UniqueId id)
 {
-    currentGraph.destroy(id);
+    beginEdit(Hyperedges{id});
+    mpGraph->destroy(id);
+    endEdit(tr("Remove %1").arg(QString::fromStdString(id)));
+    touch(id);
     visualize();
 }
 
 void HypergraphScene::connectEdges(const UniqueId fromId, const UniqueId id, const UniqueId toId)
 {
+    beginEdit(Hyperedges{id});
     if (!fromId.empty())
-        currentGraph.pointsFrom(Hyperedges{id}, Hyperedges{fromId});
+        mpGraph->pointsFrom(Hyperedges{id}, Hyperedges{fromId});
     if (!toId.empty())
-        currentGraph.pointsTo(Hyperedges{id}, Hyperedges{toId});
+        mpGraph->pointsTo(Hyperedges{id}, Hyperedges{toId});
+    endEdit(tr("Connect %1").arg(QString::fromStdString(id)));
+    // NOTE: The connections are stored in (and wired from) the edge itself
+    touch(id);
     visualize();
 }
 
 void HypergraphScene::updateEdge(const UniqueId id, const QString& label)
 {
-    currentGraph.access(id).label(label.toStdString());
+    // A single relabeling is never merged with others
+    beginLabelSession();
+    recordLabels(Hyperedges{id}, label);
+    mpGraph->access(id).label(label.toStdString());
+    touch(id);
     visualize();
 }
 
-void HypergraphScene::visualize(const Hypergraph& graph)
+void HypergraphScene::updateEdges(const Hyperedges& ids, const QString& label)
 {
-    // Merge
-    currentGraph.importFrom(graph);
+    recordLabels(ids, label);
+    for (const UniqueId& id : ids)
+    {
+        if (!mpGraph->exists(id))
+            continue;
+        mpGraph->access(id).label(label.toStdString());
+        // Only existing items have to be refreshed
+        const UidIndex::Index index(mUids.find(id));
+        if (itemAtIndex(index))
+            mPendingLabels.insert(index);
+    }
+    if (!mPendingLabels.empty() && !mpLabelTimer->isActive())
+        mpLabelTimer->start();
+}
 
-    // ... and visualize
-    visualize();
+void HypergraphScene::refreshLabels()
+{
+    std::set<UidIndex::Index> indices;
+    indices.swap(mPendingLabels);
+    for (const UidIndex::Index index : indices)
+    {
+        HyperedgeItem *item = itemAtIndex(index);
+        if (item && mpGraph->exists(mUids.uid(index)))
+            refreshLabel(item);
+    }
 }
 
-void HypergraphScene::visualize()
+void HypergraphScene::refreshLabel(HyperedgeItem *item)
 {
-    // Suppress visualisation if desired
-    if (!isEnabled())
-        return;
+    item->setLabel(QString::fromStdString(mpGraph->access(item->getHyperEdgeId()).label()));
+}
 
-    // Now get all edges of the graph
-    auto allEdges = currentGraph.findByLabel();
+void HypergraphScene::beginEdit(const Hyperedges& ids)
+{
+    mEditIds = ids;
+    mEditBefore = captureStates(ids);
+}
 
-    // Then we go through all edges and check if we already have an HyperedgeItem or not
-    QMap<UniqueId,HyperedgeItem*> validItems;
-    for (auto edgeId : allEdges)
+void HypergraphScene::recordNew(const Hyperedges& ids)
+{
+    Hyperedges pending(ids);
+    while (!pending.empty())
     {
-        if (!currentGraph.exists(edgeId))
+        const UniqueId id(pending.back());
+        pending.pop_back();
+        if (std::find(mEditIds.begin(), mEditIds.end(), id) != mEditIds.end())
             continue;
-        // Create or get item
-        HyperedgeItem *item;
-        if (!currentItems.contains(edgeId))
+        // The edge did not exist before the edit
+        EdgeState state;
+        state.id = id;
+        state.exists = false;
+        mEditIds.push_back(id);
+        mEditBefore.append(state);
+        const Hyperedges others(mpGraph->isPointingFrom(Hyperedges{id}));
+        pending.insert(pending.end(), others.begin(), others.end());
+    }
+}
+
+void HypergraphScene::endEdit(const QString& text)
+{
+    if (!mEditIds.empty())
+    {
+        const QVector<EdgeState> after(captureStates(mEditIds));
+        mpUndoStack->push(new GraphDelta(this, text, mEditBefore, after));
+        // The neighbours before and after the edit are affected as well
+        Hyperedges changed(mEditIds);
+        for (int i = 0; i < after.size(); ++i)
         {
-            item = new HyperedgeItem(edgeId);
-            addItem(item);
-            currentItems[edgeId] = item;
-        } else {
-            item = currentItems[edgeId];
+            collectAffected(mEditBefore.at(i), changed);
+            collectAffected(after.at(i), changed);
         }
-        validItems[edgeId] = item;
+        edgesChanged(changed);
     }
-    
-    // Everything which is in validItem should be wired
-    QMap<UniqueId,HyperedgeItem*>::const_iterator it;
-    for (it = validItems.begin(); it != validItems.end(); ++it)
+    mEditIds.clear();
+    mEditBefore.clear();
+}
+
+void HypergraphScene::recordLabels(const Hyperedges& ids, const QString& label)
+{
+    QVector<LabelChange> changes;
+    for (const UniqueId& id : ids)
     {
-        auto edgeId = it.key();
-        auto srcItem = it.value();
-        auto edge = currentGraph.access(edgeId);
-        // Make sure that item and edge share the same label
-        srcItem->setLabel(QString::fromStdString(edge.label()));
-        for (auto otherId : edge.pointingTo())
+        if (!mpGraph->exists(id))
+            continue;
+        LabelChange change;
+        change.id = id;
+        change.before = mpGraph->access(id).label();
+        change.after = label.toStdString();
+        changes.append(change);
+    }
+    if (!changes.isEmpty())
+        mpUndoStack->push(new GraphDelta(this, tr("Relabel"), changes, mLabelSession));
+}
+
+QVector<EdgeState> HypergraphScene::captureStates(const Hyperedges& ids)
+{
+    QVector<EdgeState> states(ids.size());
+    for (std::size_t i = 0; i < ids.size(); ++i)
+    {
+        EdgeState& state(states[i]);
+        state.id = ids[i];
+        state.exists = mpGraph->exists(state.id);
+        if (!state.exists)
+            continue;
+        const Hyperedge& edge(mpGraph->access(state.id));
+        state.label = edge.label();
+        state.from = edge.pointingFrom();
+        state.to = edge.pointingTo();
+
+        // Ask the graph for the other edges pointing to the captured one (no need to visit all edges)
+        for (const UniqueId& otherId : mpGraph->isPointingFrom(Hyperedges{state.id}))
+        {
+            if (otherId != state.id)
+                state.incomingFrom.push_back(otherId);
+        }
+        for (const UniqueId& otherId : mpGraph->isPointingTo(Hyperedges{state.id}))
         {
-            if (!validItems.contains(otherId))
+            if (otherId != state.id)
+                state.incomingTo.push_back(otherId);
+        }
+    }
+    return states;
+}
+
+void HypergraphScene::collectAffected(const EdgeState& state, Hyperedges& affected)
+{
+    affected.insert(affected.end(), state.from.begin(), state.from.end());
+    affected.insert(affected.end(), state.to.begin(), state.to.end());
+    // E.g. the instances of a removed class are connected to it by facts pointing to it
+    for (const Hyperedges* incoming : { &state.incomingFrom, &state.incomingTo })
+    {
+        for (const UniqueId& otherId : *incoming)
+        {
+            affected.push_back(otherId);
+            if (!mpGraph->exists(otherId))
                 continue;
-            // Create line if needed
-            auto destItem = validItems[otherId];
-            // Omit loops
-            if (srcItem == destItem)
+            const Hyperedges from(mpGraph->access(otherId).pointingFrom());
+            const Hyperedges to(mpGraph->access(otherId).pointingTo());
+            affected.insert(affected.end(), from.begin(), from.end());
+            affected.insert(affected.end(), to.begin(), to.end());
+        }
+    }
+}
+
+void HypergraphScene::restoreEdges(const QVector<EdgeState>& states)
+{
+    if (states.isEmpty())
+        return;
+
+    // First: Remove all edges (but remember what they pointed to)
+    Hyperedges touched;
+    for (const EdgeState& state : states)
+    {
+        if (!mpGraph->exists(state.id))
+            continue;
+        const Hyperedges from(mpGraph->access(state.id).pointingFrom());
+        const Hyperedges to(mpGraph->access(state.id).pointingTo());
+        touched.insert(touched.end(), from.begin(), from.end());
+        touched.insert(touched.end(), to.begin(), to.end());
+        mpGraph->destroy(state.id);
+    }
+    // Second: (Re-)Create all edges which existed in that state
+    for (const EdgeState& state : states)
+    {
+        if (state.exists)
+            mpGraph->create(state.id, state.label);
+    }
+    // Third: Restore all connections (from and to the edges)
+    for (const EdgeState& state : states)
+    {
+        touched.push_back(state.id);
+        if (!state.exists)
+            continue;
+        for (const UniqueId& otherId : state.from)
+        {
+            if (!mpGraph->exists(otherId))
                 continue;
-            // Check if there is an edgeitem of type TO which points to destItem
-            bool found = false;
-            auto myEdgeItems = srcItem->getEdgeItems();
-            for (auto line : myEdgeItems)
-            {
-                if (line->getType() != EdgeItem::TO)
-                    continue;
-                if (line->getTargetItem() == destItem)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
-            {
-                auto line = new EdgeItem(srcItem, destItem, EdgeItem::TO);
-                addItem(line);
-            }
+            mpGraph->pointsFrom(Hyperedges{state.id}, Hyperedges{otherId});
+            touched.push_back(otherId);
         }
-        for (auto otherId : edge.pointingFrom())
+        for (const UniqueId& otherId : state.to)
         {
-            if (!validItems.contains(otherId))
+            if (!mpGraph->exists(otherId))
                 continue;
-            // Create line if needed
-            auto destItem = validItems[otherId];
-            // Omit loops
-            if (srcItem == destItem)
+            mpGraph->pointsTo(Hyperedges{state.id}, Hyperedges{otherId});
+            touched.push_back(otherId);
+        }
+        for (const UniqueId& otherId : state.incomingFrom)
+        {
+            if (!mpGraph->exists(otherId))
                 continue;
-            // Check if there is an edgeitem of type TO which points to destItem
-            bool found = false;
-            auto myEdgeItems = srcItem->getEdgeItems();
-            for (auto line : myEdgeItems)
-            {
-                if (line->getType() != EdgeItem::FROM)
-                    continue;
-                if (line->getTargetItem() == destItem)
-                {
-                    found = true;
-                    break;
-                }
-            }
-            if (!found)
+            mpGraph->pointsFrom(Hyperedges{otherId}, Hyperedges{state.id});
+            touched.push_back(otherId);
+        }
+        for (const UniqueId& otherId : state.incomingTo)
+        {
+            if (!mpGraph->exists(otherId))
+                continue;
+            mpGraph->pointsTo(Hyperedges{otherId}, Hyperedges{state.id});
+            touched.push_back(otherId);
+        }
+    }
+    // The neighbours of the incoming edges are affected as well
+    for (const EdgeState& state : states)
+        collectAffected(state, touched);
+    edgesChanged(touched);
+    refreshEdges(touched);
+}
+
+void HypergraphScene::restoreLabel(const UniqueId& id, const std::string& label)
+{
+    if (!mpGraph->exists(id))
+        return;
+    mpGraph->access(id).label(label);
+    const UidIndex::Index index(mUids.find(id));
+    if (!itemAtIndex(index))
+        return;
+    mPendingLabels.insert(index);
+    if (!mpLabelTimer->isActive())
+        mpLabelTimer->start();
+}
+
+void HypergraphScene::refreshEdges(const Hyperedges& ids)
+{
+    // Incremental update through the journal
+    for (const UniqueId& id : ids)
+        touch(id);
+    visualize();
+}
+
+void HypergraphScene::touch(const UniqueId& id)
+{
+    mJournal.insert(mUids.intern(id));
+}
+
+HyperedgeItem* HypergraphScene::itemOf(const UniqueId& id) const
+{
+    return itemAtIndex(mUids.find(id));
+}
+
+void HypergraphScene::setItemAtIndex(const UidIndex::Index index, HyperedgeItem *item)
+{
+    if (index >= (UidIndex::Index)currentItems.size())
+        currentItems.resize(index + 1);
+    currentItems[index] = item;
+}
+
+void HypergraphScene::resync()
+{
+    mResyncPending = true;
+    visualize();
+}
+
+void HypergraphScene::visualize(const Hypergraph& graph)
+{
+    // Merge (this can not be undone)
+    mpGraph->importFrom(graph);
+    mpUndoStack->clear();
+
+    // ... and visualize everything
+    resync();
+}
+
+void HypergraphScene::visualize()
+{
+    // Suppress visualisation if desired
+    // NOTE: The journal keeps collecting changes meanwhile
+    if (!isEnabled())
+        return;
+
+    if (mResyncPending)
+    {
+        synchronize();
+        return;
+    }
+
+    // Apply the journal only
+    std::set<UidIndex::Index> journal;
+    journal.swap(mJournal);
+
+    // First: create or remove the items of all touched edges
+    for (const UidIndex::Index index : journal)
+    {
+        const UniqueId& edgeId(mUids.uid(index));
+        if (mpGraph->exists(edgeId))
+        {
+            if (!itemAtIndex(index))
             {
-                auto line = new EdgeItem(srcItem, destItem, EdgeItem::FROM);
-                addItem(line);
+                HyperedgeItem *item = new HyperedgeItem(edgeId);
+                addItem(item);
+                setItemAtIndex(index, item);
             }
+        } else if (itemAtIndex(index)) {
+            removeHyperedgeItem(edgeId);
         }
     }
 
-    // Everything which is in currentItems but not in validItems has to be removed
-    // First: remove edges
-    QMap<UniqueId,HyperedgeItem*> toBeChecked(currentItems);
-    for (it = toBeChecked.begin(); it != toBeChecked.end(); ++it)
+    // Second: update labels and connections of the touched edges
+    for (const UidIndex::Index index : journal)
+    {
+        HyperedgeItem *item = itemAtIndex(index);
+        if (item)
+            wire(item);
+    }
+}
+
+void HypergraphScene::synchronize()
+{
+    mResyncPending = false;
+    mJournal.clear();
+    beginBulkUpdate();
+    mFullLoad = true;
+
+    // Now get all edges of the graph
+    auto allEdges = mpGraph->findByLabel();
+
+    // Then we go through all edges and check if we already have an HyperedgeItem or not
+    QVector<UidIndex::Index> validIndices;
+    for (auto edgeId : allEdges)
     {
-        auto id = it.key();
-        if (validItems.contains(id))
+        if (!mpGraph->exists(edgeId))
             continue;
-        auto item = it.value();
-        auto edgeSet = item->getEdgeItems();
-        for (auto edge : edgeSet)
+        // Create or get item
+        const UidIndex::Index index(mUids.intern(edgeId));
+        if (!itemAtIndex(index))
         {
-            edge->deregister();
-            delete edge;
+            HyperedgeItem *item = new HyperedgeItem(edgeId);
+            addItem(item);
+            setItemAtIndex(index, item);
         }
+        validIndices.append(index);
     }
 
-    // Everything which is in currentItems but not in validItems has to be removed
-    // Second: remove items
-    for (it = toBeChecked.begin(); it != toBeChecked.end(); ++it)
+    // Everything which is in currentItems but not valid has to be removed
+    QVector<bool> valid(currentItems.size(), false);
+    for (const UidIndex::Index index : validIndices)
+        valid[index] = true;
+    for (int index = 0; index < currentItems.size(); ++index)
     {
-        auto id = it.key();
-        if (validItems.contains(id))
+        if (currentItems.at(index) && !valid.at(index))
+            removeHyperedgeItem(mUids.uid(index));
+    }
+
+    // Everything which is valid should be wired
+    for (const UidIndex::Index index : validIndices)
+        wire(currentItems.at(index));
+    endBulkUpdate();
+}
+
+void HypergraphScene::wire(HyperedgeItem *srcItem)
+{
+    auto edge = mpGraph->access(srcItem->getHyperEdgeId());
+    // Make sure that item and edge share the same label
+    srcItem->setLabel(QString::fromStdString(edge.label()));
+    // Drop lines which are not backed by the graph anymore (e.g. after an undo)
+    const Hyperedges to(edge.pointingTo());
+    const Hyperedges from(edge.pointingFrom());
+    const QSet<EdgeItem*> lines(srcItem->getEdgeItems());
+    for (auto line : lines)
+    {
+        if (line->getSourceItem() != srcItem)
+            continue;
+        const Hyperedges& valid(line->getType() == EdgeItem::TO ? to : from);
+        if (std::find(valid.begin(), valid.end(), line->getTargetItem()->getHyperEdgeId()) != valid.end())
             continue;
-        auto item = it.value();
-        currentItems.remove(id);
-        delete item;
+        line->deregister();
+        delete line;
     }
+    for (auto otherId : to)
+    {
+        // Create line if needed
+        auto destItem = itemOf(otherId);
+        // Omit loops & edges which are not visualized
+        if (!destItem || (srcItem == destItem))
+            continue;
+        // Check if there is an edgeitem of type TO which points to destItem
+        if (!srcItem->findEdgeItem(destItem, EdgeItem::TO))
+        {
+            auto line = new EdgeItem(srcItem, destItem, EdgeItem::TO);
+            addItem(line);
+        }
+    }
+    for (auto otherId : from)
+    {
+        // Create line if needed
+        auto destItem = itemOf(otherId);
+        // Omit loops & edges which are not visualized
+        if (!destItem || (srcItem == destItem))
+            continue;
+        // Check if there is an edgeitem of type FROM which points to destItem
+        if (!srcItem->findEdgeItem(destItem, EdgeItem::FROM))
+        {
+            auto line = new EdgeItem(srcItem, destItem, EdgeItem::FROM);
+            addItem(line);
+        }
+    }
+}
+
+void HypergraphScene::removeHyperedgeItem(const UniqueId& id)
+{
+    const UidIndex::Index index(mUids.find(id));
+    HyperedgeItem *item = itemAtIndex(index);
+    if (!item)
+        return;
+    setItemAtIndex(index, NULL);
+    // First: remove edges
+    auto edgeSet = item->getEdgeItems();
+    for (auto edge : edgeSet)
+    {
+        edge->deregister();
+        delete edge;
+    }
+    // Second: remove item
+    // NOTE: Deleting the item would remove it from the scene as well, but only removeItem() emits edgeRemoved,
+    // which resumes a layout which has converged (and stopped its timer) already
+    removeItem(item);
+    delete item;
 }
 
 ForceBasedScene::ForceBasedScene(QObject * parent)
-: HypergraphScene(parent)
+: ForceBasedScene(NULL, parent)
+{
+}
+
+ForceBasedScene::ForceBasedScene(Hypergraph* graph, QObject * parent)
+: HypergraphScene(graph, parent)
 {
     mEquilibriumDistance = 100;
+    mRepulsionMode = EXACT_REPULSION;
+    mOpeningAngle = 0.8;
+    mThreadCount = QThread::idealThreadCount();
+    mLayoutMode = SINGLE_LEVEL_LAYOUT;
+    mMultilevelPending = false;
+    mLocalHops = 2;
+    mJobRevision = 0;
+    mLayoutGraphValid = false;
+    mLayoutGraphRevision = 0;
+    mTemperature = mEquilibriumDistance;
+    mEnergy = 0.;
+    mIterations = 0;
+    mProgress = 0;
+    mpWorker = new ForceLayoutWorker(this);
+    mpWorker->start();
     mpTimer = new QTimer(this);
     connect(mpTimer, SIGNAL(timeout()), this, SLOT(updateLayout()));
     mpTimer->start(1000/25);
     setLayoutEnabled(false);
+
+    // Whenever the graph (or the set of pinned items) changes, the layout has to be resumed
+    // NOTE: Edits only refine the current layout, a global layout is requested by the viewer after a complete load
+    connect(this, SIGNAL(itemAdded(QGraphicsItem*)), this, SLOT(restartLayout()));
+    connect(this, SIGNAL(itemsAdded(const QList<QGraphicsItem*>&)), this, SLOT(restartLayout()));
+    connect(this, SIGNAL(edgeRemoved(const UniqueId)), this, SLOT(restartLayout()));
+    // NOTE: (De)Selecting only (un)pins items, so the layout is resumed gently instead of being reheated
+    connect(this, SIGNAL(selectionChanged()), this, SLOT(resumeLayout()));
+    // New items and new connections are relaxed in local layout mode
+    connect(this, SIGNAL(edgeAdded(const UniqueId)), this, SLOT(markDirty(const UniqueId)));
+    connect(this, SIGNAL(edgesConnected(const UniqueId, const UniqueId)), this, SLOT(markDirty(const UniqueId, const UniqueId)));
+    connect(this, SIGNAL(itemsAdded(const QList<QGraphicsItem*>&)), this, SLOT(markDirty(const QList<QGraphicsItem*>&)));
 }
 
 ForceBasedScene::~ForceBasedScene()
 {
     mpTimer->stop();
     delete mpTimer;
+    mpWorker->stop();
+    delete mpWorker;
 }
 
 bool ForceBasedScene::isLayoutEnabled()
 {
-    return mpTimer->isActive();
+    return mLayoutEnabled;
 }
 
 void ForceBasedScene::setLayoutEnabled(bool enable)
 {
-    if (enable && !isLayoutEnabled())
-        mpTimer->start();
-    else if (!enable)
+    mLayoutEnabled = enable;
+    if (enable)
+        restartLayout();
+    else
         mpTimer->stop();
 }
 
+void ForceBasedScene::restartLayout()
+{
+    mTemperature = mEquilibriumDistance;
+    mIterations = 0;
+    mProgress = 0;
+    if (mLayoutEnabled && !mpTimer->isActive())
+        mpTimer->start();
+}
+
+void ForceBasedScene::resumeLayout()
+{
+    mTemperature = qMax(mTemperature, LAYOUT_REFINEMENT_TEMPERATURE * mEquilibriumDistance);
+    if (mLayoutEnabled && !mpTimer->isActive())
+        mpTimer->start();
+}
+
+void ForceBasedScene::invalidateLayoutGraph()
+{
+    mLayoutGraphValid = false;
+    mLayoutGraphRevision++;
+}
+
+void ForceBasedScene::restartGlobalLayout()
+{
+    // NOTE: Many changes in a row (e.g. while loading) only cause one multilevel layout
+    if (mLayoutMode == MULTILEVEL_LAYOUT)
+        mMultilevelPending = true;
+    restartLayout();
+}
+
+void ForceBasedScene::coolDown(const qreal energy)
+{
+    // Adaptive cooling: reheat slowly while the energy keeps decreasing, cool down otherwise
+    if ((mIterations > 1) && (energy < mEnergy))
+    {
+        mProgress++;
+        if (mProgress >= 5)
+        {
+            mProgress = 0;
+            mTemperature = qMin(mTemperature / LAYOUT_COOLING_FACTOR, mEquilibriumDistance);
+        }
+    } else {
+        mProgress = 0;
+        mTemperature *= LAYOUT_COOLING_FACTOR;
+    }
+    mEnergy = energy;
+}
+
 void ForceBasedScene::setEnabled(bool enable)
 {
     //setLayoutEnabled(enable);
@@ -269,6 +759,75 @@ void ForceBasedScene::setEquilibriumDistance(qreal distance)
 {
     if (distance > 0)
         mEquilibriumDistance = distance;
+    restartLayout();
+}
+
+void ForceBasedScene::setRepulsionMode(RepulsionMode mode)
+{
+    mRepulsionMode = mode;
+    restartLayout();
+}
+
+void ForceBasedScene::setOpeningAngle(qreal theta)
+{
+    if (theta > 0)
+        mOpeningAngle = theta;
+}
+
+void ForceBasedScene::setThreadCount(int count)
+{
+    if (count > 0)
+        mThreadCount = count;
+}
+
+void ForceBasedScene::setLayoutMode(LayoutMode mode)
+{
+    mLayoutMode = mode;
+    mDirtyIds.clear();
+    // The local layout overwrites the springs of the job
+    invalidateLayoutGraph();
+    restartGlobalLayout();
+}
+
+void ForceBasedScene::setLocalHops(int hops)
+{
+    if (hops >= 0)
+        mLocalHops = hops;
+    restartLayout();
+}
+
+void ForceBasedScene::markDirty(const UniqueId id)
+{
+    if (mLayoutMode == LOCAL_LAYOUT)
+        mDirtyIds.insert(mUids.intern(id));
+}
+
+void ForceBasedScene::markDirty(const UniqueId fromId, const UniqueId toId)
+{
+    markDirty(fromId);
+    markDirty(toId);
+}
+
+void ForceBasedScene::itemDetached(EdgeItem *item)
+{
+    // Both ends lose a spring (e.g. if one of them gets removed), so the neighbourhood has to be relaxed
+    markDirty(item->getSourceItem()->getHyperEdgeId(), item->getTargetItem()->getHyperEdgeId());
+}
+
+void ForceBasedScene::markDirty(const QList<QGraphicsItem*>& items)
+{
+    // Items of a full load (or import) are placed by the global layout
+    if ((mLayoutMode != LOCAL_LAYOUT) || isFullLoad())
+        return;
+    for (QGraphicsItem* item : items)
+    {
+        HyperedgeItem *edge = toHyperedgeItem(item);
+        if (edge)
+            markDirty(edge->getHyperEdgeId());
+        EdgeItem *conn = toEdgeItem(item);
+        if (conn)
+            markDirty(conn->getSourceItem()->getHyperEdgeId(), conn->getTargetItem()->getHyperEdgeId());
+    }
 }
 
 void ForceBasedScene::updateLayout()
@@ -277,122 +836,264 @@ void ForceBasedScene::updateLayout()
     if (!isEnabled())
         return;
 
-    // This is similar to Graph Drawing by Force-directed  Placement THOMAS M. J. FRUCHTERMAN* AND EDWARD M. REINGOLD 
-    qreal mEquilibriumDistance_sqr = mEquilibriumDistance * mEquilibriumDistance;
-    QMap<HyperedgeItem*, QPointF> displacements;
-    QList<QGraphicsItem*> allItems(items());
-    QList<QGraphicsItem*> excludedItems(selectedItems());
-
-    // Remove all selected items from allItems
-    for (auto item : excludedItems)
+    // Apply the positions computed by the worker for the last snapshot
+    // NOTE: If items have been added, removed, hidden or reparented in the meantime, the result is dropped
+    qreal energy;
+    if (mpWorker->fetch(mResultX, mResultY, energy) && (mJobRevision == mLayoutGraphRevision))
     {
-        allItems.removeAll(item);
+        for (int i = 0; i < mJobItems.size(); ++i)
+        {
+            HyperedgeItem* edge = mJobItems.at(i);
+            // Items might have been grabbed in the meantime
+            if (edge->isSelected())
+                continue;
+            // Only touch items which moved (and do not fight against user interaction)
+            const QPointF oldPos(mJob.x.at(i), mJob.y.at(i));
+            const QPointF newPos(mResultX.at(i), mResultY.at(i));
+            if ((newPos == oldPos) || (edge->scenePos() != oldPos))
+                continue;
+            edge->setPos(newPos);
+        }
+
+        // After a multilevel layout only a gentle refinement is needed
+        if (mJob.layoutMode == MULTILEVEL_LAYOUT)
+        {
+            mTemperature = LAYOUT_REFINEMENT_TEMPERATURE * mEquilibriumDistance;
+            mIterations = 0;
+            mProgress = 0;
+            emit layoutUpdated(energy, mIterations);
+            return;
+        }
+
+        mIterations++;
+        coolDown(energy);
+        emit layoutUpdated(mEnergy, mIterations);
+
+        // Stop burning CPU if the layout has settled (or frozen)
+        if ((mEnergy < LAYOUT_CONVERGENCE_THRESHOLD * mJobItems.size()) || (mTemperature < LAYOUT_CONVERGENCE_THRESHOLD))
+        {
+            mpTimer->stop();
+            mDirtyIds.clear();
+            return;
+        }
     }
 
-    // Remove invisible items from allItems
-    excludedItems = allItems;
-    for (auto item : excludedItems)
+    // Hand a new snapshot to the worker (if it is idle)
+    if (mpWorker->isBusy())
+        return;
+    if (mLayoutMode == LOCAL_LAYOUT)
+        buildLocalSnapshot();
+    else
+        buildSnapshot();
+    // Nothing to do (e.g. no edits in local layout mode)
+    if (mJobItems.isEmpty())
     {
-        if (!item->isVisible())
-            allItems.removeAll(item);
+        mpTimer->stop();
+        return;
     }
+    mJob.equilibriumDistance = mEquilibriumDistance;
+    mJob.repulsionMode = mRepulsionMode;
+    mJob.openingAngle = mOpeningAngle;
+    mJob.threadCount = mThreadCount;
+    mJob.bodyCount = (mLayoutMode == LOCAL_LAYOUT) ? hyperedgeItems().size() : 0;
+    mJob.temperature = mTemperature;
+    mJob.unitSteps = false;
+    mJob.layoutMode = mMultilevelPending ? MULTILEVEL_LAYOUT : SINGLE_LEVEL_LAYOUT;
+    mMultilevelPending = false;
+    mJobRevision = mLayoutGraphRevision;
+    mpWorker->submit(mJob);
+}
 
-    // Zeroing displacements & filter hyperedgeitems
-    QList<HyperedgeItem*> allHyperedgeItems;
-    QList<EdgeItem*> allEdgeItems;
-    for (auto item : allItems)
+void ForceBasedScene::rebuildLayoutGraph()
+{
+    // Dense index of all visible top level items
+    // NOTE: currentItems is ordered by the interned ids, so the index does not depend on the order of the scene items
+    QHash<HyperedgeItem*, int> indices;
+    mLayoutNodes.resize(0);
+    for (HyperedgeItem* edge : currentItems)
     {
-        auto edge = dynamic_cast<HyperedgeItem*>(item);
-        if (!edge) 
-        {
-            auto line = dynamic_cast<EdgeItem*>(item);
-            if (line)
-                allEdgeItems.append(line);
+        if (!edge || (edge->scene() != this) || edge->parentItem() || !edge->isVisible())
             continue;
-        }
-        // Ignore children
-        if (edge->parentItem())
-            continue;
-        allHyperedgeItems.append(edge);
-        displacements[edge] = QPointF(0.,0.);
+        indices[edge] = mLayoutNodes.size();
+        mLayoutNodes.append(edge);
     }
-    const unsigned int N = allHyperedgeItems.size();
 
-    // Global update
-    for (unsigned int i = 0; i < N; ++i)
+    // Springs in compressed rows: every visible edge item is stored once in the row of its source
+    mLayoutOffsets.resize(0);
+    mLayoutTargets.resize(0);
+    mLayoutOffsets.append(0);
+    for (int i = 0; i < mLayoutNodes.size(); ++i)
     {
-        HyperedgeItem* selectedEdge = allHyperedgeItems.at(i);
-        // For selected edge:
-        // a) calculate all repelling forces to other nodes
-        for (unsigned int j = i; j < N; ++j)
+        // The edge items of children belong to their parent
+        QList<QGraphicsItem*> members(mLayoutNodes.at(i)->childItems());
+        members.prepend(mLayoutNodes.at(i));
+        for (auto member : members)
         {
-            HyperedgeItem* other = allHyperedgeItems.at(j);
-            if (other == selectedEdge)
+            auto edge = toHyperedgeItem(member);
+            if (!edge)
                 continue;
-            QPointF delta(selectedEdge->scenePos() - other->scenePos()); // points towards selectedEdge
-            qreal length_sqr = delta.x() * delta.x() + delta.y() * delta.y();
-
-            // Push away according to charge model
-            // Actually, charges should be proportional to size
-            if (length_sqr > 1e-9)
+            for (auto line : edge->getEdgeItems())
             {
-                qreal length = qSqrt(length_sqr);
-                // Skip if distance is one order of magnitude greater than equilibrium distance
-                if (length < mEquilibriumDistance * 10.)
-                {
-                    displacements[selectedEdge] +=  mEquilibriumDistance_sqr * mEquilibriumDistance * delta / length / length_sqr / N; // ~ 1/d^2 * 1/N
-                    displacements[other]        -=  mEquilibriumDistance_sqr * mEquilibriumDistance * delta / length / length_sqr / N; // ~ 1/d^2 * 1/N
-                }
-            } 
+                if (!line->isVisible() || (line->getSourceItem() != edge))
+                    continue;
+                auto target = line->getTargetItem();
+                if (target->parentItem())
+                    target = toHyperedgeItem(target->parentItem());
+                if (!indices.contains(target) || (indices[target] == i))
+                    continue;
+                mLayoutTargets.append(indices[target]);
+            }
         }
+        mLayoutOffsets.append(mLayoutTargets.size());
     }
 
-    // b) find all EdgeItems and calc attraction forces
-    for (auto line : allEdgeItems)
+    // The springs of the job only change with the layout graph
+    mJob.edgeSources.resize(mLayoutTargets.size());
+    for (int i = 0; i < mLayoutNodes.size(); ++i)
     {
-        // Calculate attraction between connected nodes
-        auto source = line->getSourceItem();
-        auto target = line->getTargetItem();
-
-        // If source || target have parent items use them instead
-        if (source->parentItem())
-            source = dynamic_cast<HyperedgeItem*>(source->parentItem());
-        if (target->parentItem())
-            target = dynamic_cast<HyperedgeItem*>(target->parentItem());
-
-        QPointF delta(source->scenePos() - target->scenePos()); // points towards source
-        qreal length_sqr = delta.x() * delta.x() + delta.y() * delta.y();
+        for (int k = mLayoutOffsets.at(i); k < mLayoutOffsets.at(i + 1); ++k)
+            mJob.edgeSources[k] = i;
+    }
+    mJob.edgeTargets = mLayoutTargets;
+    mLayoutGraphValid = true;
+}
 
-        // Pull according to a spring
-        if (length_sqr > 1e-9)
-        {
-            qreal length = qSqrt(length_sqr);
-            displacements[source] -=  (1. - mEquilibriumDistance / length) * delta / N; // ~ d/N
-            displacements[target] +=  (1. - mEquilibriumDistance / length) * delta / N;
-        } 
+void ForceBasedScene::buildSnapshot()
+{
+    if (!mLayoutGraphValid)
+        rebuildLayoutGraph();
+
+    // Refresh positions & pinned (selected) items in place
+    // NOTE: In steady state this neither allocates nor needs any RTTI
+    const int n = mLayoutNodes.size();
+    mJob.x.resize(n);
+    mJob.y.resize(n);
+    mJob.pinned.resize(n);
+    mJob.frozen.resize(n);
+    qreal* x(mJob.x.data());
+    qreal* y(mJob.y.data());
+    bool* pinned(mJob.pinned.data());
+    bool* frozen(mJob.frozen.data());
+    for (int i = 0; i < n; ++i)
+    {
+        HyperedgeItem* edge = mLayoutNodes.at(i);
+        const QPointF pos(edge->scenePos());
+        x[i] = pos.x();
+        y[i] = pos.y();
+        pinned[i] = edge->isSelected();
+        frozen[i] = false;
     }
+    mJobItems = mLayoutNodes;
+}
 
-    // Update positions
-    for (auto edge : allHyperedgeItems)
+void ForceBasedScene::buildLocalSnapshot()
+{
+    // Breadth first search starting at all dirty items: Items up to mLocalHops away may move,
+    // the next ring is frozen and ties the neighbourhood to the rest of the (untouched) layout.
+    // NOTE: Only the neighbourhood is visited, so the costs do not depend on the size of the scene
+    QHash<HyperedgeItem*, int> indices;
+    QVector<HyperedgeItem*> region;
+    QVector<int> hops;
+    mJob.x.resize(0);
+    mJob.y.resize(0);
+    mJob.pinned.resize(0);
+    mJob.frozen.resize(0);
+    mJob.edgeSources.resize(0);
+    mJob.edgeTargets.resize(0);
+    for (const UidIndex::Index index : mDirtyIds)
     {
-        // Check for bad values
-        if (std::isnan(displacements[edge].x()) || std::isnan(displacements[edge].y()))
+        HyperedgeItem* edge = itemAtIndex(index);
+        if (edge && edge->parentItem())
+            edge = toHyperedgeItem(edge->parentItem());
+        if (!edge || !edge->isVisible() || indices.contains(edge))
             continue;
-        if (std::isinf(displacements[edge].x()) || std::isinf(displacements[edge].y()))
-            continue;
-        QPointF newPos(edge->scenePos() + displacements[edge]); // x = x + disp
-        if (edge->parentItem())
+        indices[edge] = region.size();
+        region.append(edge);
+        hops.append(0);
+    }
+    for (int r = 0; r < region.size(); ++r)
+    {
+        // The edge items of children belong to their parent
+        QList<QGraphicsItem*> members(region.at(r)->childItems());
+        members.prepend(region.at(r));
+        for (auto member : members)
         {
-            edge->setPos(edge->mapFromScene(newPos));
-        } else {
-            edge->setPos(newPos);
+            auto edge = toHyperedgeItem(member);
+            if (!edge)
+                continue;
+            for (auto line : edge->getEdgeItems())
+            {
+                if (!line->isVisible())
+                    continue;
+                auto source = line->getSourceItem();
+                auto target = line->getTargetItem();
+                if (source->parentItem())
+                    source = toHyperedgeItem(source->parentItem());
+                if (target->parentItem())
+                    target = toHyperedgeItem(target->parentItem());
+                if (!source || !target || (source == target))
+                    continue;
+                auto other = (source == region.at(r)) ? target : source;
+                if (!indices.contains(other))
+                {
+                    // Do not grow beyond the frozen ring
+                    if ((hops.at(r) > mLocalHops) || !other->isVisible())
+                        continue;
+                    indices[other] = region.size();
+                    region.append(other);
+                    hops.append(hops.at(r) + 1);
+                }
+                // Every spring is added once (by its source)
+                if (source == region.at(r))
+                {
+                    mJob.edgeSources.append(indices[source]);
+                    mJob.edgeTargets.append(indices[target]);
+                }
+            }
+        }
+    }
+    // Items close to the region repel it as well (like the frozen ring), otherwise it would drift into them
+    // NOTE: The index of the scene only yields items within the cutoff distance of the repulsion
+    if (!region.isEmpty())
+    {
+        QPointF minPos(region.at(0)->scenePos());
+        QPointF maxPos(minPos);
+        for (HyperedgeItem* edge : region)
+        {
+            const QPointF pos(edge->scenePos());
+            minPos.setX(qMin(minPos.x(), pos.x()));
+            minPos.setY(qMin(minPos.y(), pos.y()));
+            maxPos.setX(qMax(maxPos.x(), pos.x()));
+            maxPos.setY(qMax(maxPos.y(), pos.y()));
+        }
+        const qreal cutoff(10. * mEquilibriumDistance);
+        const QRectF bounds(QRectF(minPos, maxPos).adjusted(-cutoff, -cutoff, cutoff, cutoff));
+        for (QGraphicsItem* item : items(bounds, Qt::IntersectsItemBoundingRect, Qt::AscendingOrder))
+        {
+            HyperedgeItem* edge = toHyperedgeItem(item);
+            if (!edge || edge->parentItem() || !edge->isVisible() || indices.contains(edge))
+                continue;
+            indices[edge] = region.size();
+            region.append(edge);
+            hops.append(mLocalHops + 1);
         }
     }
+    for (int r = 0; r < region.size(); ++r)
+    {
+        const QPointF pos(region.at(r)->scenePos());
+        mJob.x.append(pos.x());
+        mJob.y.append(pos.y());
+        mJob.pinned.append(region.at(r)->isSelected());
+        mJob.frozen.append(hops.at(r) > mLocalHops);
+    }
+    mJobItems = region;
 }
 
 HypergraphView::HypergraphView(QWidget *parent)
 : QGraphicsView(parent)
 {
+    mpCachedScene = NULL;
+    mpHypergraphScene = NULL;
     setAcceptDrops(true);
     setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing |
                        QPainter::SmoothPixmapTransform);
@@ -401,6 +1102,8 @@ HypergraphView::HypergraphView(QWidget *parent)
 HypergraphView::HypergraphView ( HypergraphScene * scene, QWidget * parent)
 : QGraphicsView(scene, parent)
 {
+    mpCachedScene = NULL;
+    mpHypergraphScene = NULL;
     setAcceptDrops(true);
     setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing |
                        QPainter::SmoothPixmapTransform);
@@ -444,7 +1147,7 @@ void HypergraphView::mousePressEvent(QMouseEvent* event)
         // enable panning by pressing+dragging the left mouse button if there is
         // _no_ HyperedgeItem under the cursor right now.
         // else we have select item mode (if there is an item)
-        if (!item || !dynamic_cast<HyperedgeItem*>(item))
+        if (!toHyperedgeItem(item))
         {
             setDragMode(QGraphicsView::ScrollHandDrag);
         }
@@ -474,13 +1177,29 @@ HypergraphEdit::HypergraphEdit(HypergraphScene * scene, QWidget * parent)
 void HypergraphEdit::keyPressEvent(QKeyEvent * event)
 {
     QList<HyperedgeItem *> selHItems = scene()->selectedHyperedgeItems();
-    if (event->key() == Qt::Key_Delete)
+    if (event->matches(QKeySequence::Undo))
     {
+        scene()->undoStack()->undo();
+    }
+    else if (event->matches(QKeySequence::Redo))
+    {
+        scene()->undoStack()->redo();
+    }
+    else if ((event->key() == Qt::Key_Delete) && !selHItems.isEmpty())
+    {
+        // Deleting the selection can be undone at once
+        // NOTE: The edges are removed ordered by their ids, so the recorded history does not depend on the selection order
+        Hyperedges ids;
         for (HyperedgeItem *hitem : selHItems)
+            ids.push_back(hitem->getHyperEdgeId());
+        std::sort(ids.begin(), ids.end());
+        scene()->undoStack()->beginMacro(tr("Delete"));
+        for (const UniqueId& id : ids)
         {
             // Delete edge from graph
-            scene()->removeEdge(hitem->getHyperEdgeId());
+            scene()->removeEdge(id);
         }
+        scene()->undoStack()->endMacro();
     }
     else if (event->key() == Qt::Key_Insert)
     {
@@ -495,7 +1214,7 @@ void HypergraphEdit::keyPressEvent(QKeyEvent * event)
     else if (event->key() == Qt::Key_Pause)
     {
         // Toggle force based layout on or off
-        ForceBasedScene *fbscene = dynamic_cast<ForceBasedScene*>(scene());
+        ForceBasedScene *fbscene = qobject_cast<ForceBasedScene*>(scene());
         if (fbscene)
         {
             fbscene->setLayoutEnabled(!fbscene->isLayoutEnabled());
@@ -508,6 +1227,7 @@ void HypergraphEdit::keyPressEvent(QKeyEvent * event)
             // Start label edit
             isEditLabelMode = true;
             currentLabel = "";
+            scene()->beginLabelSession();
         }
         // Update current label
         if (event->key() != Qt::Key_Backspace)
@@ -516,10 +1236,12 @@ void HypergraphEdit::keyPressEvent(QKeyEvent * event)
         } else {
             currentLabel.chop(1);
         }
+        Hyperedges ids;
         for (HyperedgeItem *hitem : selHItems)
         {
-            scene()->updateEdge(hitem->getHyperEdgeId(), currentLabel);
+            ids.push_back(hitem->getHyperEdgeId());
         }
+        scene()->updateEdges(ids, currentLabel);
         setDefaultLabel(currentLabel);
     }
 
@@ -536,7 +1258,7 @@ void HypergraphEdit::mousePressEvent(QMouseEvent* event)
     else if (event->button() == Qt::RightButton)
     {
         // If pressed on a HyperedgeItem we start drawing a line
-        auto edge = dynamic_cast<HyperedgeItem*>(item);
+        auto edge = toHyperedgeItem(item);
         if (edge)
         {
             lineItem = new QGraphicsLineItem();
@@ -567,7 +1289,7 @@ void HypergraphEdit::mouseReleaseEvent(QMouseEvent* event)
     if ((event->button() == Qt::RightButton) && isDrawLineMode)
     {
         // Check if there is a item at current pos
-        auto edge = dynamic_cast<HyperedgeItem*>(item);
+        auto edge = toHyperedgeItem(item);
         if (edge)
         {
             // Ask for Direction
@@ -617,9 +1339,11 @@ HypergraphViewer::HypergraphViewer(QWidget *parent, bool doSetup)
         layout->addWidget(mpView);
         mpUi->View->setLayout(layout);
 
-        mpUi->usageLabel->setText("LMB: Select  RMB: Associate  WHEEL: Zoom  DEL: Delete  INS: Insert  PAUSE: Toggle Layouting");
+        mpUi->usageLabel->setText("LMB: Select  RMB: Associate  WHEEL: Zoom  DEL: Delete  INS: Insert  PAUSE: Toggle Layouting  CTRL+Z/Y: Undo/Redo");
 
         connect(mpScene, SIGNAL(itemAdded(QGraphicsItem*)), this, SLOT(onGraphChanged(QGraphicsItem*)));
+        connect(mpScene, SIGNAL(itemsAdded(const QList<QGraphicsItem*>&)), this, SLOT(onItemsAdded(const QList<QGraphicsItem*>&)));
+        connect(mpScene, SIGNAL(layoutUpdated(qreal,unsigned int)), this, SLOT(onLayoutUpdated(qreal,unsigned int)));
     } else {
         mpUi = NULL;
         mpScene = NULL;
@@ -668,18 +1392,113 @@ void HypergraphViewer::loadFromYAML(const QString& yamlString)
 void HypergraphViewer::storeToYAML()
 {
     emit YAMLStringReady(QString::fromStdString(YAML::StringFrom(mpScene->graph())));
+
+    // Positions of all top level items (children are placed by their parents), sorted by id for a stable output
+    QMap<UniqueId, QPointF> positions;
+    for (HyperedgeItem* hitem : mpScene->hyperedgeItems())
+    {
+        if (hitem->parentItem())
+            continue;
+        positions[hitem->getHyperEdgeId()] = hitem->pos();
+    }
+    YAML::Emitter out;
+    out << YAML::BeginMap;
+    for (auto it = positions.constBegin(); it != positions.constEnd(); ++it)
+    {
+        out << YAML::Key << it.key();
+        out << YAML::Value << YAML::Flow << YAML::BeginSeq << it.value().x() << it.value().y() << YAML::EndSeq;
+    }
+    out << YAML::EndMap;
+    emit positionsYAMLReady(QString::fromStdString(out.c_str()));
+}
+
+void HypergraphViewer::loadPositionsFromYAMLFile(const QString& fileName)
+{
+    if (!QFile::exists(fileName))
+        return;
+    try {
+        YAML::Node positions(YAML::LoadFile(fileName.toStdString()));
+        for (YAML::const_iterator it = positions.begin(); it != positions.end(); ++it)
+        {
+            const UniqueId id(it->first.as<UniqueId>());
+            mStoredPositions[id] = QPointF(it->second[0].as<qreal>(), it->second[1].as<qreal>());
+        }
+    } catch (const YAML::Exception& e) {
+        std::cerr << "Ignoring positions in " << fileName.toStdString() << ": " << e.what() << std::endl;
+    }
+}
+
+bool HypergraphViewer::restorePosition(HyperedgeItem* item)
+{
+    auto it = mStoredPositions.find(item->getHyperEdgeId());
+    if (it == mStoredPositions.end())
+        return false;
+    item->setPos(it.value());
+    // Only restore once, items created later on are new ones
+    mStoredPositions.erase(it);
+    return true;
+}
+
+void HypergraphViewer::onItemsAdded(const QList<QGraphicsItem*>& items)
+{
+    // Place all new items around the center of the view
+    QPointF centerOfView(mpView->mapToScene(mpView->viewport()->rect().center()));
+    bool restored = false;
+    for (QGraphicsItem* item : items)
+    {
+        // Children (e.g. of HAS-A relations) are placed by their parents
+        HyperedgeItem *hitem(toHyperedgeItem(item));
+        if (!hitem || hitem->parentItem())
+            continue;
+        if (restorePosition(hitem))
+        {
+            restored = true;
+            continue;
+        }
+        QPointF noise(qrand() % 100 - 50, qrand() % 100 - 50);
+        item->setPos(centerOfView + noise);
+    }
+    // A complete load gets a global layout unless its stored positions have been restored
+    if (mpScene->isFullLoad() && !restored)
+        mpScene->restartGlobalLayout();
+    // ... and update the stats once
+    onGraphChanged(UniqueId());
 }
 
 void HypergraphViewer::onGraphChanged(const UniqueId id)
 {
     // update stats
-    mpUi->statsLabel->setText("HE: " + QString::number(mpScene->graph().findByLabel().size()));
+    mGraphStats = "HE: " + QString::number(mpScene->graph().findByLabel().size());
+    updateStats();
+}
+
+void HypergraphViewer::onLayoutUpdated(qreal energy, unsigned int iterations)
+{
+    mLayoutStats = "ENERGY: " + QString::number(energy, 'f', 2) + "  ITERATIONS: " + QString::number(iterations);
+    updateStats();
+}
+
+QLabel* HypergraphViewer::statsLabel()
+{
+    return mpUi->statsLabel;
+}
+
+void HypergraphViewer::updateStats()
+{
+    if (mLayoutStats.isEmpty())
+        statsLabel()->setText(mGraphStats);
+    else
+        statsLabel()->setText(mGraphStats + "  " + mLayoutStats);
 }
 
 void HypergraphViewer::onGraphChanged(QGraphicsItem* item)
 {
-    HyperedgeItem *hitem(dynamic_cast< HyperedgeItem *>(item));
-    if (!hitem)
+    // Children (e.g. of HAS-A relations) are placed by their parents
+    HyperedgeItem *hitem(toHyperedgeItem(item));
+    if (!hitem || hitem->parentItem())
+        return;
+    // Known items go to their stored positions
+    if (restorePosition(hitem))
         return;
     // Get current scene pos of view
     QPointF centerOfView(mpView->mapToScene(mpView->viewport()->rect().center()));
@@ -693,10 +1512,41 @@ void HypergraphViewer::clearHypergraph()
     for (auto edgeId : edges)
         mpScene->graph().destroy(edgeId);
     // update stats
-    mpUi->statsLabel->setText("HE: " + QString::number(mpScene->graph().findByLabel().size()));
+    mGraphStats = "HE: " + QString::number(mpScene->graph().findByLabel().size());
+    updateStats();
 }
 
 void HypergraphViewer::setEquilibriumDistance(qreal distance)
 {
     mpScene->setEquilibriumDistance(distance);
 }
+
+void HypergraphViewer::setRepulsionMode(RepulsionMode mode)
+{
+    mpScene->setRepulsionMode(mode);
+}
+
+void HypergraphViewer::setOpeningAngle(qreal theta)
+{
+    mpScene->setOpeningAngle(theta);
+}
+
+void HypergraphViewer::setThreadCount(int count)
+{
+    mpScene->setThreadCount(count);
+}
+
+void HypergraphViewer::setLayoutMode(LayoutMode mode)
+{
+    mpScene->setLayoutMode(mode);
+}
+
+void HypergraphViewer::setLocalHops(int hops)
+{
+    mpScene->setLocalHops(hops);
+}
+
+void HypergraphViewer::setDeterministic(bool enable)
+{
+    mpScene->setDeterministic(enable);
+}
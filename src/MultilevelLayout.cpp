@@ -0,0 +1,286 @@
+#include "MultilevelLayout.hpp"
+#include "ForceLayout.hpp"
+#include <QtCore>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+// Coarsening stops at this number of bodies ...
+#define MULTILEVEL_MIN_BODIES 32
+// ... or if a level keeps more than this fraction of the bodies of the finer one
+#define MULTILEVEL_MIN_REDUCTION 0.9
+#define MULTILEVEL_MAX_LEVELS 32
+// The natural spring length grows by sqrt(7/4) per coarser level (Walshaw)
+#define MULTILEVEL_SPRING_SCALE 1.3228756555322954
+// Iteration budgets of the coarsest and of all other levels
+#define MULTILEVEL_COARSEST_ITERATIONS 300
+#define MULTILEVEL_REFINE_ITERATIONS 50
+// Large levels get fewer iterations: at most this many body updates per level (but at least the minimum)
+// NOTE: The finest levels dominate the cost, but they start from an already good interpolated layout
+#define MULTILEVEL_REFINE_WORK 500000
+#define MULTILEVEL_MIN_ITERATIONS 10
+// Step length factor of the adaptive step control (Hu)
+#define MULTILEVEL_STEP_FACTOR 0.9
+// A level is settled if the step length drops below this fraction of its spring length
+#define MULTILEVEL_TOLERANCE 0.01
+// Children are placed around their parent within this fraction of the spring length (which is also the initial step)
+#define MULTILEVEL_SPREAD 0.1
+
+// Deterministic offset of body i: a sunflower pattern avoids coincident children
+static void spread(const int i, const qreal radius, qreal& x, qreal& y)
+{
+    const qreal angle(2.39996322972865332 * i); // golden angle
+    x += radius * std::cos(angle);
+    y += radius * std::sin(angle);
+}
+
+MultilevelLayout::MultilevelLayout()
+{
+}
+
+MultilevelLayout::~MultilevelLayout()
+{
+}
+
+qreal MultilevelLayout::compute(const LayoutSnapshot& snapshot, ForceLayout& layout, QVector<qreal>& resultX, QVector<qreal>& resultY)
+{
+    // The finest level is the snapshot itself
+    mLevels.resize(1);
+    mLevels[0].x = snapshot.x;
+    mLevels[0].y = snapshot.y;
+    mLevels[0].pinned = snapshot.pinned;
+    mLevels[0].edgeSources = snapshot.edgeSources;
+    mLevels[0].edgeTargets = snapshot.edgeTargets;
+    mLevels[0].mass.fill(1, snapshot.x.size());
+    mLevels[0].equilibriumDistance = snapshot.equilibriumDistance;
+
+    // Coarsen until the graph is small or does not shrink anymore
+    while (mLevels.size() < MULTILEVEL_MAX_LEVELS)
+    {
+        const int n = mLevels.last().x.size();
+        if (n <= MULTILEVEL_MIN_BODIES)
+            break;
+        Level coarse;
+        coarsen(mLevels.last(), coarse);
+        if (coarse.x.size() > MULTILEVEL_MIN_REDUCTION * n)
+            break;
+        coarse.equilibriumDistance = mLevels.last().equilibriumDistance * MULTILEVEL_SPRING_SCALE;
+        mLevels.append(coarse);
+    }
+
+    // All levels share the parameters of the snapshot but always use Barnes-Hut repulsion and unit steps
+    LayoutSnapshot job;
+    job.repulsionMode = BARNES_HUT_REPULSION;
+    job.openingAngle = snapshot.openingAngle;
+    job.threadCount = snapshot.threadCount;
+    job.bodyCount = 0;
+    job.unitSteps = true;
+    job.layoutMode = SINGLE_LEVEL_LAYOUT;
+
+    // Layout the coarsest level from the centroids of the current positions
+    const int coarsest = mLevels.size() - 1;
+    Level& top(mLevels[coarsest]);
+    for (int i = 0; i < top.x.size(); ++i)
+    {
+        if (!top.pinned.at(i))
+            spread(i, MULTILEVEL_SPREAD * top.equilibriumDistance, top.x[i], top.y[i]);
+    }
+    qreal energy = refine(top, job, layout, MULTILEVEL_COARSEST_ITERATIONS, top.equilibriumDistance);
+
+    // Interpolate and refine level by level
+    for (int l = coarsest - 1; l >= 0; --l)
+    {
+        prolong(mLevels.at(l + 1), mLevels[l]);
+        const int iterations = qBound(MULTILEVEL_MIN_ITERATIONS, MULTILEVEL_REFINE_WORK / qMax(mLevels.at(l).x.size(), 1),
+                                      MULTILEVEL_REFINE_ITERATIONS);
+        energy = refine(mLevels[l], job, layout, iterations, MULTILEVEL_SPREAD * mLevels.at(l).equilibriumDistance);
+    }
+
+    resultX = mLevels.at(0).x;
+    resultY = mLevels.at(0).y;
+    return energy;
+}
+
+void MultilevelLayout::coarsen(Level& fine, Level& coarse)
+{
+    const int n = fine.x.size();
+    const int E = fine.edgeSources.size();
+
+    // Build the (symmetric) adjacency in compressed rows
+    mOffsets.fill(0, n + 1);
+    for (int e = 0; e < E; ++e)
+    {
+        const int s = fine.edgeSources.at(e);
+        const int t = fine.edgeTargets.at(e);
+        if (s == t)
+            continue;
+        mOffsets[s + 1]++;
+        mOffsets[t + 1]++;
+    }
+    for (int i = 0; i < n; ++i)
+        mOffsets[i + 1] += mOffsets.at(i);
+    mNeighbours.resize(mOffsets.at(n));
+    QVector<int> cursor(mOffsets);
+    for (int e = 0; e < E; ++e)
+    {
+        const int s = fine.edgeSources.at(e);
+        const int t = fine.edgeTargets.at(e);
+        if (s == t)
+            continue;
+        mNeighbours[cursor[s]++] = t;
+        mNeighbours[cursor[t]++] = s;
+    }
+
+    // Match every free body with its lightest unmatched free neighbour.
+    // If all neighbours are already taken, collapse it into the lightest neighbouring cluster (e.g. leaves of a star).
+    // NOTE: Pinned bodies always stay on their own
+    // NOTE: Bodies are visited in a (fixed) random order, a linear order would only match along rows of grid-like graphs
+    mOrder.resize(n);
+    for (int i = 0; i < n; ++i)
+        mOrder[i] = i;
+    std::shuffle(mOrder.begin(), mOrder.end(), std::minstd_rand(n));
+    fine.parent.fill(-1, n);
+    coarse.mass.resize(0);
+    for (int i = 0; i < n; ++i)
+    {
+        const int u = mOrder.at(i);
+        if (fine.parent.at(u) >= 0)
+            continue;
+        if (fine.pinned.at(u))
+        {
+            fine.parent[u] = coarse.mass.size();
+            coarse.mass.append(fine.mass.at(u));
+            continue;
+        }
+        int best = -1;
+        int cluster = -1;
+        for (int k = mOffsets.at(u); k < mOffsets.at(u + 1); ++k)
+        {
+            const int v = mNeighbours.at(k);
+            if (fine.pinned.at(v))
+                continue;
+            const int c = fine.parent.at(v);
+            if (c < 0)
+            {
+                if ((best < 0) || (fine.mass.at(v) < fine.mass.at(best)))
+                    best = v;
+            } else {
+                if ((cluster < 0) || (coarse.mass.at(c) < coarse.mass.at(cluster)))
+                    cluster = c;
+            }
+        }
+        if (best >= 0)
+        {
+            fine.parent[u] = coarse.mass.size();
+            fine.parent[best] = coarse.mass.size();
+            coarse.mass.append(fine.mass.at(u) + fine.mass.at(best));
+        } else if (cluster >= 0) {
+            fine.parent[u] = cluster;
+            coarse.mass[cluster] += fine.mass.at(u);
+        } else {
+            fine.parent[u] = coarse.mass.size();
+            coarse.mass.append(fine.mass.at(u));
+        }
+    }
+
+    // Coarse bodies start at the centroid of their members
+    const int m = coarse.mass.size();
+    QVector<int> members(m, 0);
+    coarse.x.fill(0., m);
+    coarse.y.fill(0., m);
+    coarse.pinned.fill(false, m);
+    for (int i = 0; i < n; ++i)
+    {
+        const int c = fine.parent.at(i);
+        coarse.x[c] += fine.x.at(i);
+        coarse.y[c] += fine.y.at(i);
+        coarse.pinned[c] = fine.pinned.at(i);
+        members[c]++;
+    }
+    for (int c = 0; c < m; ++c)
+    {
+        coarse.x[c] /= members.at(c);
+        coarse.y[c] /= members.at(c);
+    }
+
+    // Map springs to the coarse bodies, dropping internal and duplicate ones
+    mEdgeKeys.resize(0);
+    for (int e = 0; e < E; ++e)
+    {
+        const quint64 a = fine.parent.at(fine.edgeSources.at(e));
+        const quint64 b = fine.parent.at(fine.edgeTargets.at(e));
+        if (a == b)
+            continue;
+        mEdgeKeys.append(a < b ? (a << 32) | b : (b << 32) | a);
+    }
+    std::sort(mEdgeKeys.begin(), mEdgeKeys.end());
+    coarse.edgeSources.resize(0);
+    coarse.edgeTargets.resize(0);
+    for (int k = 0; k < mEdgeKeys.size(); ++k)
+    {
+        if (k && (mEdgeKeys.at(k) == mEdgeKeys.at(k - 1)))
+            continue;
+        coarse.edgeSources.append(mEdgeKeys.at(k) >> 32);
+        coarse.edgeTargets.append(mEdgeKeys.at(k) & 0xffffffff);
+    }
+}
+
+void MultilevelLayout::prolong(const Level& coarse, Level& fine)
+{
+    const qreal radius(MULTILEVEL_SPREAD * fine.equilibriumDistance);
+    for (int i = 0; i < fine.x.size(); ++i)
+    {
+        // Pinned bodies keep their own positions
+        if (fine.pinned.at(i))
+            continue;
+        const int c = fine.parent.at(i);
+        fine.x[i] = coarse.x.at(c);
+        fine.y[i] = coarse.y.at(c);
+        spread(i, radius, fine.x[i], fine.y[i]);
+    }
+}
+
+qreal MultilevelLayout::refine(Level& level, LayoutSnapshot& job, ForceLayout& layout, const int iterations, const qreal step)
+{
+    job.x = level.x;
+    job.y = level.y;
+    job.pinned = level.pinned;
+    job.frozen.fill(false, level.x.size());
+    job.edgeSources = level.edgeSources;
+    job.edgeTargets = level.edgeTargets;
+    // A collapsed body repels like all the bodies it represents
+    job.mass.resize(level.mass.size());
+    for (int i = 0; i < level.mass.size(); ++i)
+        job.mass[i] = level.mass.at(i);
+    job.equilibriumDistance = level.equilibriumDistance;
+    job.temperature = step;
+
+    // Adaptive step length: grow it after steady progress, shrink it otherwise
+    qreal energy(0.);
+    unsigned int progress(0);
+    for (int iteration = 0; iteration < iterations; ++iteration)
+    {
+        const qreal newEnergy(layout.iterate(job, mResultX, mResultY));
+        qSwap(job.x, mResultX);
+        qSwap(job.y, mResultY);
+        if ((iteration > 0) && (newEnergy < energy))
+        {
+            progress++;
+            if (progress >= 5)
+            {
+                progress = 0;
+                job.temperature = qMin(job.temperature / MULTILEVEL_STEP_FACTOR, level.equilibriumDistance);
+            }
+        } else {
+            progress = 0;
+            job.temperature *= MULTILEVEL_STEP_FACTOR;
+        }
+        energy = newEnergy;
+        if (job.temperature < MULTILEVEL_TOLERANCE * level.equilibriumDistance)
+            break;
+    }
+
+    level.x = job.x;
+    level.y = job.y;
+    return energy;
+}
@@ -0,0 +1,180 @@
+#include "QuadTree.hpp"
+#include <QVarLengthArray>
+#include <QtCore>
+
+// Limits subdivision if many bodies share (almost) the same position
+#define QUADTREE_MAX_DEPTH 32
+
+QuadTree::QuadTree()
+{
+}
+
+QuadTree::~QuadTree()
+{
+}
+
+int QuadTree::createNode(const QPointF& center, const qreal halfSize)
+{
+    Node node;
+    node.center = center;
+    node.halfSize = halfSize;
+    node.centerOfMass = QPointF(0.,0.);
+    node.mass = 0.;
+    node.count = 0;
+    node.body = -1;
+    for (int q = 0; q < 4; ++q)
+        node.children[q] = -1;
+    mNodes.append(node);
+    return mNodes.size() - 1;
+}
+
+void QuadTree::build(const QVector<qreal>& x, const QVector<qreal>& y, const QVector<qreal>& mass)
+{
+    mX = x;
+    mY = y;
+    mMass = mass;
+    mNodes.resize(0);
+    if (mX.isEmpty())
+        return;
+
+    // Find the bounding square of all bodies
+    qreal minX(mX.at(0)), maxX(minX);
+    qreal minY(mY.at(0)), maxY(minY);
+    for (int i = 1; i < mX.size(); ++i)
+    {
+        minX = qMin(minX, mX.at(i));
+        maxX = qMax(maxX, mX.at(i));
+        minY = qMin(minY, mY.at(i));
+        maxY = qMax(maxY, mY.at(i));
+    }
+    const qreal halfSize(qMax(maxX - minX, maxY - minY) / 2. + 1.);
+    createNode(QPointF((minX + maxX) / 2., (minY + maxY) / 2.), halfSize);
+
+    // Insert all bodies
+    for (int i = 0; i < mX.size(); ++i)
+        insert(i);
+
+    // Turn the accumulated position sums into the centers of mass
+    for (Node& node : mNodes)
+    {
+        if (node.mass > 0.)
+            node.centerOfMass /= node.mass;
+    }
+}
+
+void QuadTree::insert(const int i)
+{
+    const QPointF p(mX.at(i), mY.at(i));
+    const qreal m(mMass.isEmpty() ? 1. : mMass.at(i));
+    int current = 0;
+    int depth = 0;
+    while (true)
+    {
+        mNodes[current].centerOfMass += m * p;
+        mNodes[current].mass += m;
+        mNodes[current].count++;
+
+        // An empty cell just takes the body
+        if (mNodes[current].count == 1)
+        {
+            mNodes[current].body = i;
+            return;
+        }
+
+        // Stop subdividing: the cell will be treated as one aggregated charge
+        if (depth >= QUADTREE_MAX_DEPTH)
+        {
+            mNodes[current].body = -1;
+            return;
+        }
+
+        // If this cell holds a single body, push it down first
+        const int other = mNodes[current].body;
+        if (other >= 0)
+        {
+            mNodes[current].body = -1;
+            const QPointF o(mX.at(other), mY.at(other));
+            const QPointF c(mNodes[current].center);
+            const int q = (o.x() >= c.x() ? 1 : 0) + (o.y() >= c.y() ? 2 : 0);
+            if (mNodes[current].children[q] < 0)
+            {
+                const qreal h(mNodes[current].halfSize / 2.);
+                const int child = createNode(QPointF(c.x() + (q & 1 ? h : -h), c.y() + (q & 2 ? h : -h)), h);
+                mNodes[current].children[q] = child;
+            }
+            Node& child(mNodes[mNodes[current].children[q]]);
+            const qreal mo(mMass.isEmpty() ? 1. : mMass.at(other));
+            child.centerOfMass += mo * o;
+            child.mass += mo;
+            child.count++;
+            child.body = other;
+        }
+
+        // Descend into the proper quadrant
+        const QPointF c(mNodes[current].center);
+        const int q = (p.x() >= c.x() ? 1 : 0) + (p.y() >= c.y() ? 2 : 0);
+        if (mNodes[current].children[q] < 0)
+        {
+            const qreal h(mNodes[current].halfSize / 2.);
+            const int child = createNode(QPointF(c.x() + (q & 1 ? h : -h), c.y() + (q & 2 ? h : -h)), h);
+            mNodes[current].children[q] = child;
+        }
+        current = mNodes[current].children[q];
+        depth++;
+    }
+}
+
+QPointF QuadTree::repulsion(const int i, const qreal equilibriumDistance, const qreal theta) const
+{
+    QPointF result(0.,0.);
+    if (mNodes.isEmpty())
+        return result;
+
+    const QPointF p(mX.at(i), mY.at(i));
+    const qreal cutoff_sqr(100. * equilibriumDistance * equilibriumDistance);
+    const qreal charge(equilibriumDistance * equilibriumDistance * equilibriumDistance);
+    const qreal theta_sqr(theta * theta);
+
+    QVarLengthArray<int, 128> stack;
+    stack.append(0);
+    while (stack.size())
+    {
+        const Node& node(mNodes.at(stack.last()));
+        stack.removeLast();
+        if (!node.count)
+            continue;
+
+        // Skip cells which lie completely beyond the cutoff distance
+        const qreal outsideX(qMax(qAbs(p.x() - node.center.x()) - node.halfSize, qreal(0.)));
+        const qreal outsideY(qMax(qAbs(p.y() - node.center.y()) - node.halfSize, qreal(0.)));
+        if ((outsideX * outsideX + outsideY * outsideY) >= cutoff_sqr)
+            continue;
+
+        // A body never repels itself
+        if (node.body == i)
+            continue;
+
+        const QPointF delta(p - node.centerOfMass); // points towards body i
+        const qreal length_sqr = delta.x() * delta.x() + delta.y() * delta.y();
+        const bool isLeaf((node.children[0] < 0) && (node.children[1] < 0) && (node.children[2] < 0) && (node.children[3] < 0));
+        const bool containsBody((outsideX <= 0.) && (outsideY <= 0.));
+
+        // Opening criterion: cell size / distance < theta (never approximate a cell which contains body i)
+        if (isLeaf || (!containsBody && (4. * node.halfSize * node.halfSize < theta_sqr * length_sqr)))
+        {
+            if ((length_sqr > 1e-9) && (length_sqr < cutoff_sqr))
+            {
+                const qreal length = qSqrt(length_sqr);
+                result += node.mass * charge * delta / length / length_sqr; // ~ 1/d^2
+            }
+            continue;
+        }
+
+        for (int q = 0; q < 4; ++q)
+        {
+            if (node.children[q] >= 0)
+                stack.append(node.children[q]);
+        }
+    }
+    return result;
+}
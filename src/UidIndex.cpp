@@ -0,0 +1,27 @@
+#include "UidIndex.hpp"
+
+const UidIndex::Index UidIndex::NONE;
+
+UidIndex::UidIndex()
+{
+}
+
+UidIndex::~UidIndex()
+{
+}
+
+UidIndex::Index UidIndex::intern(const UniqueId& uid)
+{
+    auto result(mIndices.insert(std::make_pair(uid, (Index)mUids.size())));
+    if (result.second)
+        mUids.push_back(&result.first->first);
+    return result.first->second;
+}
+
+UidIndex::Index UidIndex::find(const UniqueId& uid) const
+{
+    auto it(mIndices.find(uid));
+    if (it == mIndices.end())
+        return NONE;
+    return it->second;
+}
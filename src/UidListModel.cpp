@@ -0,0 +1,132 @@
+#include "UidListModel.hpp"
+#include <QTimer>
+
+UidListModel::UidListModel(QObject *parent)
+: QAbstractListModel(parent)
+{
+    mFlushPending = false;
+}
+
+UidListModel::~UidListModel()
+{
+}
+
+int UidListModel::rowCount(const QModelIndex& parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return mUids.size();
+}
+
+QVariant UidListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || (index.row() >= mUids.size()))
+        return QVariant();
+    if (role == Qt::DisplayRole)
+        return mUids.at(index.row());
+    return QVariant();
+}
+
+void UidListModel::insert(const UniqueId uid)
+{
+    const QString id(QString::fromStdString(uid));
+    // Undo a queued removal or queue the insertion of a new one
+    if (mPendingRemoves.remove(id))
+        return;
+    if (mRows.contains(id) || mPendingInsertSet.contains(id))
+        return;
+    mPendingInserts.append(id);
+    mPendingInsertSet.insert(id);
+    scheduleFlush();
+}
+
+void UidListModel::remove(const UniqueId uid)
+{
+    const QString id(QString::fromStdString(uid));
+    // Undo a queued insertion or queue the removal of an existing one
+    // NOTE: The id stays in mPendingInserts and gets skipped by flush()
+    if (mPendingInsertSet.remove(id))
+        return;
+    if (!mRows.contains(id))
+        return;
+    mPendingRemoves.insert(id);
+    scheduleFlush();
+}
+
+void UidListModel::assign(const Hyperedges& uids)
+{
+    QSet<QString> wanted;
+    for (const UniqueId& uid : uids)
+    {
+        wanted.insert(QString::fromStdString(uid));
+        insert(uid);
+    }
+    for (const QString& id : mUids)
+    {
+        if (!wanted.contains(id))
+            remove(id.toStdString());
+    }
+    for (const QString& id : QStringList(mPendingInserts))
+    {
+        if (mPendingInsertSet.contains(id) && !wanted.contains(id))
+            remove(id.toStdString());
+    }
+}
+
+void UidListModel::flush()
+{
+    mFlushPending = false;
+
+    // Removals: a single row is removed directly, everything else resets the views once
+    if (mPendingRemoves.size() == 1)
+    {
+        const int row = mRows.value(*mPendingRemoves.begin());
+        beginRemoveRows(QModelIndex(), row, row);
+        mUids.removeAt(row);
+        endRemoveRows();
+    } else if (mPendingRemoves.size() > 1) {
+        beginResetModel();
+        QStringList remaining;
+        remaining.reserve(mUids.size() - mPendingRemoves.size());
+        for (const QString& id : mUids)
+        {
+            if (!mPendingRemoves.contains(id))
+                remaining.append(id);
+        }
+        mUids = remaining;
+        endResetModel();
+    }
+    if (!mPendingRemoves.isEmpty())
+    {
+        mPendingRemoves.clear();
+        mRows.clear();
+        for (int row = 0; row < mUids.size(); ++row)
+            mRows.insert(mUids.at(row), row);
+    }
+
+    // Insertions are appended in one go (dropping the ones which have been undone meanwhile)
+    if (!mPendingInsertSet.isEmpty())
+    {
+        const int first = mUids.size();
+        beginInsertRows(QModelIndex(), first, first + mPendingInsertSet.size() - 1);
+        for (const QString& id : mPendingInserts)
+        {
+            // NOTE: Removing the id from the set also skips duplicates of an id which got inserted again
+            if (!mPendingInsertSet.remove(id))
+                continue;
+            mRows.insert(id, mUids.size());
+            mUids.append(id);
+        }
+        endInsertRows();
+    }
+    mPendingInserts.clear();
+    mPendingInsertSet.clear();
+}
+
+void UidListModel::scheduleFlush()
+{
+    if (mFlushPending)
+        return;
+    mFlushPending = true;
+    QTimer::singleShot(0, this, SLOT(flush()));
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 
 #include <QApplication>
+#include <QStringList>
 #include <QTime>
 
 #include "HypergraphGUI.hpp"
@@ -11,11 +12,30 @@ int main(int argc, char **argv)
     // setting up qt application
     QApplication app(argc, argv);
 
+    // An explicit seed (--seed <n>) makes placement, Z order and layout reproducible
+    int seed = 0;
+    QStringList args(app.arguments());
+    int idx = args.indexOf("--seed");
+    if ((idx > 0) && (idx + 1 < args.size()))
+    {
+        bool ok = false;
+        seed = args.at(idx + 1).toInt(&ok);
+        if (!ok || (seed < 1))
+        {
+            std::cerr << "Invalid seed " << args.at(idx + 1).toStdString() << ", expected a positive integer" << std::endl;
+            return 1;
+        }
+    }
+
     // provide seed for force-based layouting in the LayerViewWidget and
     // ComponentEditorWidget
-    qsrand(QTime(0,0,0).secsTo(QTime::currentTime()));
+    if (seed > 0)
+        qsrand(seed);
+    else
+        qsrand(QTime(0,0,0).secsTo(QTime::currentTime()));
 
     HypergraphGUI w;
+    w.setSeedRequest(seed);
     w.show();
 
     app.setApplicationName(w.windowTitle());